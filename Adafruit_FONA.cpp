@@ -29,6 +29,60 @@
 // http://postwarrior.com/arduino-ethershield-error-prog_char-does-not-name-a-type/
 
 #include "Adafruit_FONA.h"
+#include "FONAGnss.h"
+#include "FONAHTTPClient.h"
+#include "FONASMSPDU.h"
+
+// Which HTTP parameters are currently set on the module (httpcache)
+#define FONA_HTTP_CACHE_INIT 0x01
+#define FONA_HTTP_CACHE_CID 0x02
+#define FONA_HTTP_CACHE_URL 0x04
+#define FONA_HTTP_CACHE_UA 0x08
+#define FONA_HTTP_CACHE_CONTENT 0x10
+#define FONA_HTTP_CACHE_REDIR 0x20
+#define FONA_HTTP_CACHE_USERDATA 0x40
+
+/**
+ * @brief FNV-1a digest of a string, so the HTTP caches don't need a copy
+ *
+ * @param s The string to hash
+ * @param h The digest to continue from
+ * @return uint32_t The digest
+ */
+static uint32_t hashString(const char* s, uint32_t h = 2166136261UL) {
+  while (*s) {
+    h ^= (uint8_t)*s++;
+    h *= 16777619UL;
+  }
+  return h;
+}
+
+/**
+ * @brief FNV-1a digest of a buffer
+ *
+ * @param p Pointer to the data
+ * @param len The length of the data
+ * @param h The digest to continue from
+ * @return uint32_t The digest
+ */
+static uint32_t hashBytes(const uint8_t* p, uint16_t len,
+                          uint32_t h = 2166136261UL) {
+  while (len--) {
+    h ^= *p++;
+    h *= 16777619UL;
+  }
+  return h;
+}
+
+// Asynchronous HTTPACTION progress (httpactionstate)
+#define FONA_HTTP_ACTION_IDLE 0
+#define FONA_HTTP_ACTION_PENDING 1
+#define FONA_HTTP_ACTION_DONE 2
+
+// Most bytes AT+CHTTPSSEND takes at once, and bytes asked for with each
+// AT+CHTTPSRECV
+#define FONA_HTTPS_SEND_MAX 4096
+#define FONA_HTTPS_RECV_MAX 512
 
 #if defined(ESP8266)
 // ESP8266 doesn't have the min and max functions natively available like
@@ -54,6 +108,18 @@ Adafruit_FONA::Adafruit_FONA(int8_t rst) {
   httpsredirect = false;
   useragent = F("FONA");
   ok_reply = F("OK");
+  urcflags = 0;
+  httpsession = false;
+  httpcache = 0;
+  httpurlhash = 0;
+  httplastua = 0;
+  httplastcontent = 0;
+  httpactionstate = FONA_HTTP_ACTION_IDLE;
+  httpheaders = 0;
+  httpuserdatahash = 0;
+  smsref = 0;
+  smsqueuehead = 0;
+  smsqueuelen = 0;
 }
 
 /**
@@ -753,6 +819,45 @@ uint8_t Adafruit_FONA::getSMSInterrupt(void) {
 bool Adafruit_FONA::setSMSInterrupt(uint8_t i) {
   return sendCheckReply(F("AT+CFGRI="), i, ok_reply);
 }
+/**
+ * @brief Turn +CMTI new message indications on or off. While on, the index
+ * of each received SMS is queued for getNewSMS().
+ *
+ * @param onoff true: enable, false: disable
+ * @return true: success, false: failure
+ */
+bool Adafruit_FONA::setSMSNotify(bool onoff) {
+  smsqueuehead = 0;
+  smsqueuelen = 0;
+  return sendCheckReply(onoff ? F("AT+CNMI=2,1") : F("AT+CNMI=2,0"), ok_reply);
+}
+
+/**
+ * @brief Take the index of the next newly received SMS. Needs
+ * setSMSNotify(true); costs no AT commands.
+ *
+ * @param timeout How long to wait for a message, in milliseconds. 0 only
+ * handles what is already buffered.
+ * @return int16_t The index to pass to readSMS(), -1 if nothing arrived
+ */
+int16_t Adafruit_FONA::getNewSMS(uint16_t timeout) {
+  while (smsqueuelen == 0) {
+    readURCs();
+    if ((smsqueuelen > 0) || !timeout)
+      break;
+    delay(1);
+    timeout--;
+  }
+
+  if (smsqueuelen == 0)
+    return -1;
+
+  uint8_t index = smsqueue[smsqueuehead];
+  smsqueuehead = (smsqueuehead + 1) % FONA_SMS_QUEUE;
+  smsqueuelen--;
+  return index;
+}
+
 /**
  * @brief Get the number of SMS
  *
@@ -779,16 +884,14 @@ int8_t Adafruit_FONA::getNumSMS(void) {
 // or debug printouts!
 
 /**
- * @brief Read an SMS message into a provided buffer
+ * @brief Send AT+CMGR and parse the body length out of its header line. The
+ * body follows on the port.
  *
  * @param message_index The SMS message index to retrieve
- * @param smsbuff SMS message buffer
- * @param maxlen The maximum read length
- * @param readlen The length read
+ * @param smslen Set to the body length reported by the module
  * @return true: success, false: failure
  */
-bool Adafruit_FONA::readSMS(uint8_t message_index, char* smsbuff,
-                            uint16_t maxlen, uint16_t* readlen) {
+bool Adafruit_FONA::readSMSStart(uint8_t message_index, uint16_t* smslen) {
   // text mode
   if (!sendCheckReply(F("AT+CMGF=1"), ok_reply))
     return false;
@@ -797,9 +900,6 @@ bool Adafruit_FONA::readSMS(uint8_t message_index, char* smsbuff,
   if (!sendCheckReply(F("AT+CSDH=1"), ok_reply))
     return false;
 
-  // parse out the SMS len
-  uint16_t thesmslen = 0;
-
   DEBUG_PRINT(F("AT+CMGR="));
   DEBUG_PRINTLN(message_index);
 
@@ -808,30 +908,81 @@ bool Adafruit_FONA::readSMS(uint8_t message_index, char* smsbuff,
   mySerial->println(message_index);
   readline(1000); // timeout
 
-  // DEBUG_PRINT(F("Reply: ")); DEBUG_PRINTLN(replybuffer);
-  // parse it out...
-
   DEBUG_PRINTLN(replybuffer);
 
-  if (!parseReply(F("+CMGR:"), &thesmslen, ',', 11)) {
-    *readlen = 0;
+  // parse out the SMS len
+  *smslen = 0;
+  return parseReply(F("+CMGR:"), smslen, ',', 11);
+}
+
+/**
+ * @brief Read an SMS message into a provided buffer. The body is read
+ * straight from the port into the buffer, so it is not limited by the reply
+ * buffer size.
+ *
+ * @param message_index The SMS message index to retrieve
+ * @param smsbuff SMS message buffer, at least maxlen + 1 bytes
+ * @param maxlen The maximum read length
+ * @param readlen The length read
+ * @return true: success, false: failure
+ */
+bool Adafruit_FONA::readSMS(uint8_t message_index, char* smsbuff,
+                            uint16_t maxlen, uint16_t* readlen) {
+  uint16_t thesmslen;
+  *readlen = 0;
+  if (!readSMSStart(message_index, &thesmslen))
     return false;
-  }
 
-  readRaw(thesmslen);
+  uint16_t thelen = min(maxlen, thesmslen);
+  thelen = readRaw((uint8_t*)smsbuff, thelen, 1000);
+  smsbuff[thelen] = 0; // end the string
+  readRaw(NULL, thesmslen - thelen, 1000); // drop what didn't fit
 
   flushInput();
 
-  uint16_t thelen = min(maxlen, (uint16_t)strlen(replybuffer));
-  strncpy(smsbuff, replybuffer, thelen);
-  smsbuff[thelen] = 0; // end the string
-
-  DEBUG_PRINTLN(replybuffer);
+  DEBUG_PRINTLN(smsbuff);
 
   *readlen = thelen;
   return true;
 }
 
+/**
+ * @brief Read an SMS message in chunks, for bodies larger than any buffer
+ * the sketch can spare, e.g. UCS2 text as hex
+ *
+ * @param message_index The SMS message index to retrieve
+ * @param callback Called with each chunk of the body
+ * @param context Passed to the callback
+ * @param smslen Set to the body length reported by the module
+ * @return true: success, false: failure
+ */
+bool Adafruit_FONA::readSMS(uint8_t message_index,
+                            FONASMSReadCallback callback, void* context,
+                            uint16_t* smslen) {
+  uint16_t thesmslen;
+  *smslen = 0;
+  if (!readSMSStart(message_index, &thesmslen))
+    return false;
+  *smslen = thesmslen;
+
+  // the header line has been parsed, so the reply buffer holds the chunks
+  uint16_t offset = 0;
+  bool wanted = true;
+  while (offset < thesmslen) {
+    uint16_t len = min((uint16_t)(sizeof(replybuffer) - 1),
+                       (uint16_t)(thesmslen - offset));
+    len = readRaw((uint8_t*)replybuffer, len, 1000);
+    if (!len)
+      break;
+    if (wanted)
+      wanted = callback((uint8_t*)replybuffer, len, offset, context);
+    offset += len;
+  }
+
+  flushInput();
+  return (offset == thesmslen);
+}
+
 /**
  * @brief Retrieve the sender of the specified SMS message and copy it as a
  *    string to the sender buffer.  Up to senderlen characters of the sender
@@ -869,186 +1020,650 @@ bool Adafruit_FONA::getSMSSender(uint8_t message_index, char* sender,
 }
 
 /**
- * @brief Send an SMS Message from a buffer provided
+ * @brief Get the AT+CMGL name of an SMS status
  *
- * @param smsaddr The SMS address buffer
- * @param smsmsg The SMS message buffer
- * @return true: success, false: failure
+ * @param status FONA_SMS_REC_UNREAD etc.
+ * @return FONAFlashStringPtr The name, e.g. "REC UNREAD"
  */
-bool Adafruit_FONA::sendSMS(char* smsaddr, char* smsmsg) {
-  if (!sendCheckReply(F("AT+CMGF=1"), ok_reply))
-    return false;
+static FONAFlashStringPtr smsStatusName(uint8_t status) {
+  switch (status) {
+    case FONA_SMS_REC_UNREAD:
+      return F("REC UNREAD");
+    case FONA_SMS_REC_READ:
+      return F("REC READ");
+    case FONA_SMS_STO_UNSENT:
+      return F("STO UNSENT");
+    case FONA_SMS_STO_SENT:
+      return F("STO SENT");
+    default:
+      return F("ALL");
+  }
+}
 
-  char sendcmd[30] = "AT+CMGS=\"";
-  strncpy(sendcmd + 9, smsaddr,
-          30 - 9 - 2); // 9 bytes beginning, 2 bytes for close quote + null
-  sendcmd[strlen(sendcmd)] = '\"';
+/**
+ * @brief Split the next field off a reply line. Quotes around the field are
+ * removed and commas inside them are kept.
+ *
+ * @param p Pointer to the parse position, moved past the field and its comma
+ * @return char* The field, NUL terminated in place
+ */
+static char* nextField(char** p) {
+  char* field = *p;
+  char* end;
+
+  if (*field == '"') {
+    field++;
+    end = strchr(field, '"');
+    if (!end)
+      end = field + strlen(field);
+    else
+      *end++ = 0;
+  } else {
+    end = field;
+  }
 
-  if (!sendCheckReply(sendcmd, F("> ")))
-    return false;
+  end = strchr(end, ',');
+  if (end) {
+    *end = 0;
+    *p = end + 1;
+  } else {
+    *p = field + strlen(field);
+  }
+  return field;
+}
 
-  DEBUG_PRINT(F("> "));
-  DEBUG_PRINTLN(smsmsg);
+/**
+ * @brief List stored SMS messages with a single AT+CMGL, handing each header
+ * and body to a callback as it arrives. Listing unread messages marks them
+ * read.
+ *
+ * @param status Which messages to list: FONA_SMS_REC_UNREAD, FONA_SMS_ALL
+ * etc.
+ * @param callback Function called for each message
+ * @param context Pointer passed through to the callback
+ * @param body Buffer for the message bodies. Longer bodies are cut short.
+ * @param bodylen The size of the body buffer, including the terminator
+ * @return int16_t The number of messages listed, -1 on error
+ */
+int16_t Adafruit_FONA::listSMS(uint8_t status, FONASMSCallback callback,
+                               void* context, char* body, uint16_t bodylen) {
+  if ((bodylen == 0) || !sendCheckReply(F("AT+CMGF=1"), ok_reply))
+    return -1;
 
-  mySerial->println(smsmsg);
-  mySerial->println();
-  mySerial->write(0x1A);
+  // include the length of each message in its header line
+  if (!sendCheckReply(F("AT+CSDH=1"), ok_reply))
+    return -1;
 
-  DEBUG_PRINTLN("^Z");
+  flushInput();
 
-  if ((_type == FONA3G_A) || (_type == FONA3G_E)) {
-    // Eat two sets of CRLF
-    readline(200);
-    // DEBUG_PRINT("Line 1: "); DEBUG_PRINTLN(strlen(replybuffer));
-    readline(200);
-    // DEBUG_PRINT("Line 2: "); DEBUG_PRINTLN(strlen(replybuffer));
-  }
-  readline(10000); // read the +CMGS reply, wait up to 10 seconds!!!
-  // DEBUG_PRINT("Line 3: "); DEBUG_PRINTLN(strlen(replybuffer));
-  if (strstr(replybuffer, "+CMGS") == 0) {
-    return false;
-  }
-  readline(1000); // read OK
-  // DEBUG_PRINT("* "); DEBUG_PRINTLN(replybuffer);
+  DEBUG_PRINT(F("\t---> "));
+  DEBUG_PRINT(F("AT+CMGL=\""));
+  DEBUG_PRINT(smsStatusName(status));
+  DEBUG_PRINTLN('"');
 
-  if (strcmp(replybuffer, "OK") != 0) {
-    return false;
+  mySerial->print(F("AT+CMGL=\""));
+  mySerial->print(smsStatusName(status));
+  mySerial->println('"');
+
+  int16_t count = 0;
+  bool stopped = false;
+
+  // a full SIM takes a while to list
+  while (readline(5000)) {
+    DEBUG_PRINT(F("\t<--- "));
+    DEBUG_PRINTLN(replybuffer);
+
+    if (prog_char_strcmp(replybuffer, (prog_char*)ok_reply) == 0)
+      return count;
+    if (strstr(replybuffer, "ERROR"))
+      return -1;
+
+    char* p = prog_char_strstr(replybuffer, (prog_char*)F("+CMGL: "));
+    if (p != replybuffer)
+      continue;
+    p += 7;
+
+    // <index>,<stat>,<oa/da>,[<alpha>],[<scts>],<tooa/toda>,<length>
+    FONASMSHeader header;
+    header.index = atoi(nextField(&p));
+    char* stat = nextField(&p);
+    header.status = FONA_SMS_ALL;
+    for (uint8_t i = 0; i < FONA_SMS_ALL; i++) {
+      if (prog_char_strcmp(stat, (prog_char*)smsStatusName(i)) == 0)
+        header.status = i;
+    }
+    strncpy(header.address, nextField(&p), sizeof(header.address) - 1);
+    header.address[sizeof(header.address) - 1] = 0;
+    nextField(&p);
+    strncpy(header.timestamp, nextField(&p), sizeof(header.timestamp) - 1);
+    header.timestamp[sizeof(header.timestamp) - 1] = 0;
+    nextField(&p);
+    header.length = atoi(nextField(&p));
+
+    // the body follows on its own line
+    uint16_t len = header.length;
+    if (len > bodylen - 1)
+      len = bodylen - 1;
+    len = readRaw((uint8_t*)body, len, 1000);
+    body[len] = 0;
+    readRaw(NULL, header.length - len, 1000);
+
+    if (!stopped && callback)
+      stopped = !callback(&header, body, len, context);
+    count++;
   }
 
-  return true;
+  return -1;
 }
 
 /**
- * @brief Delete an SMS Message
+ * @brief Send an SMS in PDU mode. Text that fits the GSM 7 bit alphabet is
+ * packed as such, anything else goes as UCS2. Long text is split into
+ * concatenated parts.
  *
- * @param message_index The message to delete
- * @return true: success, false: failure
+ * @param smsaddr The recipient, optionally starting with +
+ * @param text The message, UTF-8
+ * @return true: every part was sent, false: failure
  */
-bool Adafruit_FONA::deleteSMS(uint8_t message_index) {
-  if (!sendCheckReply(F("AT+CMGF=1"), ok_reply))
+bool Adafruit_FONA::sendSMSPDU(char* smsaddr, const char* text) {
+  uint8_t dcs;
+  FONASMSConcat concat;
+  concat.ref = ++smsref;
+  concat.total = FONAsmsParts(text, &dcs);
+
+  // too long to number the parts
+  if ((concat.total == 0) || !sendCheckReply(F("AT+CMGF=0"), ok_reply))
     return false;
-  // read an sms
-  char sendbuff[12] = "AT+CMGD=000";
-  sendbuff[8] = (message_index / 100) + '0';
-  message_index %= 100;
-  sendbuff[9] = (message_index / 10) + '0';
-  message_index %= 10;
-  sendbuff[10] = message_index + '0';
 
-  return sendCheckReply(sendbuff, ok_reply, 2000);
-}
+  bool ok = true;
+  for (uint16_t seq = 1; ok && (seq <= concat.total); seq++) {
+    concat.seq = seq;
+    bool multi = concat.total > 1;
+    uint8_t units;
+    const char* end = FONAsmsPart(text, dcs, multi, &units);
 
-/********* USSD *********************************************************/
+    flushInput();
+
+    DEBUG_PRINT(F("\t---> "));
+    DEBUG_PRINT(F("AT+CMGS="));
+    DEBUG_PRINTLN(FONAsmsSubmitLength(smsaddr, dcs, multi, units));
+
+    mySerial->print(F("AT+CMGS="));
+    mySerial->println(FONAsmsSubmitLength(smsaddr, dcs, multi, units));
+
+    // the prompt has no line end, so this returns after the timeout
+    ok = expectReply(F("> "), FONA_DEFAULT_TIMEOUT_MS);
+    if (ok) {
+      FONAwriteSubmit(*mySerial, smsaddr, text, end, dcs,
+                      multi ? &concat : 0, units);
+      mySerial->write(0x1A);
+      ok = smsSubmitEnd();
+    }
+    text = end;
+  }
+
+  // the rest of the SMS functions work in text mode
+  sendCheckReply(F("AT+CMGF=1"), ok_reply);
+  return ok;
+}
 
 /**
- * @brief Send USSD
+ * @brief Read an SMS in PDU mode, decoding GSM 7 bit, UCS2 or 8 bit text to
+ * UTF-8
  *
- * @param ussdmsg The USSD message buffer
- * @param ussdbuff The USSD bufer
- * @param maxlen The maximum read length
- * @param readlen The length actually read
+ * @param message_index The SMS message index to retrieve
+ * @param header Filled with the index, status, address, timestamp and the
+ * full text length
+ * @param concat Filled with the part number if the SMS is one part of a
+ * longer message
+ * @param text Buffer for the text. Longer text is cut short.
+ * @param maxlen The size of the buffer, including the terminator
  * @return true: success, false: failure
  */
-bool Adafruit_FONA::sendUSSD(char* ussdmsg, char* ussdbuff, uint16_t maxlen,
-                             uint16_t* readlen) {
-  if (!sendCheckReply(F("AT+CUSD=1"), ok_reply))
+bool Adafruit_FONA::readSMSPDU(uint8_t message_index, FONASMSHeader* header,
+                               FONASMSConcat* concat, char* text,
+                               uint16_t maxlen) {
+  if ((maxlen == 0) || !sendCheckReply(F("AT+CMGF=0"), ok_reply))
     return false;
 
-  char sendcmd[30] = "AT+CUSD=1,\"";
-  strncpy(sendcmd + 11, ussdmsg,
-          30 - 11 - 2); // 11 bytes beginning, 2 bytes for close quote + null
-  sendcmd[strlen(sendcmd)] = '\"';
+  bool ok = readPDU(message_index, header, concat, text, maxlen);
 
-  if (!sendCheckReply(sendcmd, ok_reply)) {
-    *readlen = 0;
+  sendCheckReply(F("AT+CMGF=1"), ok_reply);
+  return ok;
+}
+
+/**
+ * @brief Read a long SMS, reassembling its parts in order by scanning the
+ * storage for the other parts with one AT+CMGL
+ *
+ * @param message_index The index of any part of the message
+ * @param text Buffer for the text as UTF-8. Longer text is cut short.
+ * @param maxlen The size of the buffer, including the terminator
+ * @param readlen Set to the number of bytes stored
+ * @return true: success, false: failure or some parts haven't arrived
+ */
+bool Adafruit_FONA::readSMSConcat(uint8_t message_index, char* text,
+                                  uint16_t maxlen, uint16_t* readlen) {
+  FONASMSHeader header;
+  FONASMSConcat concat;
+
+  *readlen = 0;
+  if ((maxlen == 0) || !sendCheckReply(F("AT+CMGF=0"), ok_reply))
     return false;
-  } else {
-    readline(10000); // read the +CUSD reply, wait up to 10 seconds!!!
-    // DEBUG_PRINT("* "); DEBUG_PRINTLN(replybuffer);
-    char* p = prog_char_strstr(replybuffer, PSTR("+CUSD: "));
-    if (p == 0) {
-      *readlen = 0;
-      return false;
-    }
-    p += 7; //+CUSD
-    // Find " to get start of ussd message.
-    p = strchr(p, '\"');
-    if (p == 0) {
-      *readlen = 0;
-      return false;
-    }
-    p += 1; //"
-    // Find " to get end of ussd message.
-    char* strend = strchr(p, '\"');
 
-    uint16_t lentocopy = min(maxlen - 1, strend - p);
-    strncpy(ussdbuff, p, lentocopy + 1);
-    ussdbuff[lentocopy] = 0;
-    *readlen = lentocopy;
+  bool ok = readPDU(message_index, &header, &concat, text, maxlen);
+  uint16_t len = ok ? strlen(text) : 0;
+
+  if (ok && (concat.total > 1)) {
+    uint8_t parts[FONA_SMS_MAX_PARTS];
+    ok = (concat.total <= FONA_SMS_MAX_PARTS) &&
+         findSMSParts(header.address, &concat, parts);
+
+    len = 0;
+    for (uint8_t i = 0; ok && (i < concat.total); i++) {
+      FONASMSConcat c;
+      ok = readPDU(parts[i], &header, &c, text + len, maxlen - len);
+      // a character that didn't fit whole is left out, so count the bytes
+      if (ok)
+        len += strlen(text + len);
+    }
   }
-  return true;
-}
 
-/********* TIME **********************************************************/
+  sendCheckReply(F("AT+CMGF=1"), ok_reply);
+  text[len] = 0;
+  *readlen = len;
+  return ok;
+}
 
 /**
- * @brief Enable network time sync
+ * @brief Read one SMS with AT+CMGR, the module already in PDU mode
  *
- * @param onoff true: enable false: disable
+ * @param message_index The SMS message index to retrieve
+ * @param header Filled with the message header
+ * @param concat Filled with the concatenation info
+ * @param text Buffer for the text
+ * @param maxlen The size of the buffer, including the terminator
  * @return true: success, false: failure
  */
-bool Adafruit_FONA::enableNetworkTimeSync(bool onoff) {
-  if (onoff) {
-    if (!sendCheckReply(F("AT+CLTS=1"), ok_reply))
-      return false;
-  } else {
-    if (!sendCheckReply(F("AT+CLTS=0"), ok_reply))
-      return false;
-  }
+bool Adafruit_FONA::readPDU(uint8_t message_index, FONASMSHeader* header,
+                            FONASMSConcat* concat, char* text,
+                            uint16_t maxlen) {
+  flushInput();
 
-  flushInput(); // eat any 'Unsolicted Result Code'
+  DEBUG_PRINT(F("\t---> "));
+  DEBUG_PRINT(F("AT+CMGR="));
+  DEBUG_PRINTLN(message_index);
 
-  return true;
+  mySerial->print(F("AT+CMGR="));
+  mySerial->println(message_index);
+  readline(1000);
+
+  DEBUG_PRINT(F("\t<--- "));
+  DEBUG_PRINTLN(replybuffer);
+
+  // +CMGR: <stat>,[<alpha>],<length>, then the PDU on its own line
+  uint16_t stat;
+  if (!parseReply(F("+CMGR: "), &stat))
+    return false;
+
+  FONAPDUReader in(*mySerial, 1000);
+  bool ok = FONAreadPDU(in, header, concat, text, maxlen);
+  header->index = message_index;
+  header->status = stat;
+
+  flushInput();
+  return ok;
 }
 
 /**
- * @brief Enable NTP time sync
+ * @brief Find the storage index of every part of a long SMS with one
+ * AT+CMGL, the module already in PDU mode
  *
- * @param onoff true: enable false: disable
- * @param ntpserver The NTP server buffer
- * @return true: success, false: failure
+ * @param address The sender of the message
+ * @param concat The concatenation info of any part
+ * @param parts Filled with the index of each part, in order
+ * @return true: all parts found, false: failure or parts missing
  */
-bool Adafruit_FONA::enableNTPTimeSync(bool onoff,
-                                      FONAFlashStringPtr ntpserver) {
-  if (onoff) {
-    if (!sendCheckReply(F("AT+CNTPCID=1"), ok_reply))
-      return false;
+bool Adafruit_FONA::findSMSParts(const char* address,
+                                 const FONASMSConcat* concat,
+                                 uint8_t* parts) {
+  memset(parts, 0xFF, concat->total);
 
-    mySerial->print(F("AT+CNTP=\""));
-    if (ntpserver != 0) {
-      mySerial->print(ntpserver);
-    } else {
-      mySerial->print(F("pool.ntp.org"));
-    }
-    mySerial->println(F("\",0"));
-    readline(FONA_DEFAULT_TIMEOUT_MS);
-    if (strcmp(replybuffer, "OK") != 0)
-      return false;
+  flushInput();
 
-    if (!sendCheckReply(F("AT+CNTP"), ok_reply, 10000))
-      return false;
+  DEBUG_PRINT(F("\t---> "));
+  DEBUG_PRINTLN(F("AT+CMGL=4"));
 
-    uint16_t status;
-    readline(10000);
-    if (!parseReply(F("+CNTP:"), &status))
-      return false;
-  } else {
-    if (!sendCheckReply(F("AT+CNTPCID=0"), ok_reply))
+  mySerial->println(F("AT+CMGL=4"));
+
+  // +CMGL: <index>,<stat>,[<alpha>],<length>, then the PDU on its own line
+  while (readline(5000)) {
+    if (prog_char_strcmp(replybuffer, (prog_char*)ok_reply) == 0)
+      break;
+    if (strstr(replybuffer, "ERROR"))
       return false;
-  }
 
-  return true;
-}
+    uint16_t index;
+    if (!parseReply(F("+CMGL: "), &index))
+      continue;
+
+    FONAPDUReader in(*mySerial, 1000);
+    FONASMSHeader header;
+    FONASMSConcat part;
+    bool ok = FONAreadPDU(in, &header, &part, 0, 0);
+    in.skipLine();
+
+    if (ok && (part.ref == concat->ref) && (part.total == concat->total) &&
+        (part.seq >= 1) && (part.seq <= part.total) &&
+        (strcmp(header.address, address) == 0))
+      parts[part.seq - 1] = index;
+  }
+
+  for (uint8_t i = 0; i < concat->total; i++) {
+    if (parts[i] == 0xFF)
+      return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Wait for the module to confirm a message sent with AT+CMGS
+ *
+ * @return true: the message was sent, false: failure
+ */
+bool Adafruit_FONA::smsSubmitEnd(void) {
+  if ((_type == FONA3G_A) || (_type == FONA3G_E)) {
+    // Eat two sets of CRLF
+    readline(200);
+    readline(200);
+  }
+  readline(10000); // read the +CMGS reply, wait up to 10 seconds!!!
+  if (strstr(replybuffer, "+CMGS") == 0) {
+    return false;
+  }
+  readline(1000); // read OK
+
+  return strcmp(replybuffer, "OK") == 0;
+}
+
+/**
+ * @brief Send an SMS Message from a buffer provided
+ *
+ * @param smsaddr The SMS address buffer
+ * @param smsmsg The SMS message buffer
+ * @return true: success, false: failure
+ */
+bool Adafruit_FONA::sendSMS(char* smsaddr, char* smsmsg) {
+  if (!sendCheckReply(F("AT+CMGF=1"), ok_reply))
+    return false;
+
+  return sendSMSText(smsaddr, smsmsg);
+}
+
+/**
+ * @brief Send the same SMS to several recipients back to back. AT+CMMS keeps
+ * the radio link up between the messages and text mode is only set once.
+ *
+ * @param smsaddrs The recipients
+ * @param count The number of recipients
+ * @param smsmsg The SMS message buffer
+ * @param results Set to whether each recipient's message was sent, may be 0
+ * @return uint8_t The number of messages sent
+ */
+uint8_t Adafruit_FONA::sendSMSBurst(char** smsaddrs, uint8_t count,
+                                    char* smsmsg, bool* results) {
+  uint8_t sent = 0;
+
+  if (!sendCheckReply(F("AT+CMGF=1"), ok_reply)) {
+    for (uint8_t i = 0; results && (i < count); i++)
+      results[i] = false;
+    return 0;
+  }
+
+  // keep the link between messages; not every firmware supports it
+  if (count > 1)
+    sendCheckReply(F("AT+CMMS=1"), ok_reply);
+
+  for (uint8_t i = 0; i < count; i++) {
+    bool ok = sendSMSText(smsaddrs[i], smsmsg);
+    if (results)
+      results[i] = ok;
+    if (ok)
+      sent++;
+  }
+
+  if (count > 1)
+    sendCheckReply(F("AT+CMMS=0"), ok_reply);
+
+  return sent;
+}
+
+/**
+ * @brief Send an SMS, the module already in text mode
+ *
+ * @param smsaddr The SMS address buffer
+ * @param smsmsg The SMS message buffer
+ * @return true: success, false: failure
+ */
+bool Adafruit_FONA::sendSMSText(char* smsaddr, char* smsmsg) {
+  flushInput();
+
+  DEBUG_PRINT(F("\t---> "));
+  DEBUG_PRINT(F("AT+CMGS=\""));
+  DEBUG_PRINT(smsaddr);
+  DEBUG_PRINTLN('"');
+
+  mySerial->print(F("AT+CMGS=\""));
+  mySerial->print(smsaddr);
+  mySerial->println('"');
+
+  // the prompt has no line end, so this returns after the timeout
+  if (!expectReply(F("> "), FONA_DEFAULT_TIMEOUT_MS))
+    return false;
+
+  DEBUG_PRINT(F("> "));
+  DEBUG_PRINTLN(smsmsg);
+
+  mySerial->println(smsmsg);
+  mySerial->println();
+  mySerial->write(0x1A);
+
+  DEBUG_PRINTLN("^Z");
+
+  return smsSubmitEnd();
+}
+
+/**
+ * @brief Delete an SMS Message
+ *
+ * @param message_index The message to delete
+ * @return true: success, false: failure
+ */
+bool Adafruit_FONA::deleteSMS(uint8_t message_index) {
+  // AT+CMGD works the same in text and PDU mode
+  char sendbuff[12] = "AT+CMGD=000";
+  sendbuff[8] = (message_index / 100) + '0';
+  message_index %= 100;
+  sendbuff[9] = (message_index / 10) + '0';
+  message_index %= 10;
+  sendbuff[10] = message_index + '0';
+
+  return sendCheckReply(sendbuff, ok_reply, 2000);
+}
+
+/**
+ * @brief Delete many SMS messages with one command instead of one
+ * deleteSMS() per index
+ *
+ * @param flag Which messages to delete: FONA_SMS_DEL_READ,
+ * FONA_SMS_DEL_READ_SENT, FONA_SMS_DEL_ALL_STORED or FONA_SMS_DEL_ALL
+ * @return true: success, false: failure
+ */
+bool Adafruit_FONA::deleteAllSMS(uint8_t flag) {
+  if ((flag < FONA_SMS_DEL_READ) || (flag > FONA_SMS_DEL_ALL))
+    return false;
+
+  // the index is ignored when a flag is given; a full SIM takes a while
+  return sendCheckReply(F("AT+CMGD=1,"), flag, ok_reply, 25000);
+}
+
+/**
+ * @brief Copy one memory out of an AT+CPMS? reply
+ *
+ * @param p Pointer to the parse position, moved past the memory
+ * @param mem The memory to fill, or 0 to skip it
+ */
+static void parseSMSMemory(char** p, FONASMSMemory* mem) {
+  char* name = nextField(p);
+  uint16_t used = atoi(nextField(p));
+  uint16_t total = atoi(nextField(p));
+
+  if (!mem)
+    return;
+  strncpy(mem->name, name, sizeof(mem->name) - 1);
+  mem->name[sizeof(mem->name) - 1] = 0;
+  mem->used = used;
+  mem->total = total;
+}
+
+/**
+ * @brief Get the used and total slots of the SMS memories in one query
+ *
+ * @param read The memory messages are read and deleted from
+ * @param write The memory messages are written and sent from, may be 0
+ * @param receive The memory received messages go to, may be 0
+ * @return true: success, false: failure
+ */
+bool Adafruit_FONA::getSMSStorage(FONASMSMemory* read, FONASMSMemory* write,
+                                  FONASMSMemory* receive) {
+  getReply(F("AT+CPMS?"));
+
+  // +CPMS: "SM",1,30,"SM",1,30,"SM",1,30
+  char* p = prog_char_strstr(replybuffer, (prog_char*)F("+CPMS: "));
+  if (p == 0)
+    return false;
+
+  p += 7;
+  parseSMSMemory(&p, read);
+  parseSMSMemory(&p, write);
+  parseSMSMemory(&p, receive);
+
+  readline(); // eat 'OK'
+
+  return true;
+}
+
+/********* USSD *********************************************************/
+
+/**
+ * @brief Send USSD
+ *
+ * @param ussdmsg The USSD message buffer
+ * @param ussdbuff The USSD bufer
+ * @param maxlen The maximum read length
+ * @param readlen The length actually read
+ * @return true: success, false: failure
+ */
+bool Adafruit_FONA::sendUSSD(char* ussdmsg, char* ussdbuff, uint16_t maxlen,
+                             uint16_t* readlen) {
+  if (!sendCheckReply(F("AT+CUSD=1"), ok_reply))
+    return false;
+
+  char sendcmd[30] = "AT+CUSD=1,\"";
+  strncpy(sendcmd + 11, ussdmsg,
+          30 - 11 - 2); // 11 bytes beginning, 2 bytes for close quote + null
+  sendcmd[strlen(sendcmd)] = '\"';
+
+  if (!sendCheckReply(sendcmd, ok_reply)) {
+    *readlen = 0;
+    return false;
+  } else {
+    readline(10000); // read the +CUSD reply, wait up to 10 seconds!!!
+    // DEBUG_PRINT("* "); DEBUG_PRINTLN(replybuffer);
+    char* p = prog_char_strstr(replybuffer, PSTR("+CUSD: "));
+    if (p == 0) {
+      *readlen = 0;
+      return false;
+    }
+    p += 7; //+CUSD
+    // Find " to get start of ussd message.
+    p = strchr(p, '\"');
+    if (p == 0) {
+      *readlen = 0;
+      return false;
+    }
+    p += 1; //"
+    // Find " to get end of ussd message.
+    char* strend = strchr(p, '\"');
+
+    uint16_t lentocopy = min(maxlen - 1, strend - p);
+    strncpy(ussdbuff, p, lentocopy + 1);
+    ussdbuff[lentocopy] = 0;
+    *readlen = lentocopy;
+  }
+  return true;
+}
+
+/********* TIME **********************************************************/
+
+/**
+ * @brief Enable network time sync
+ *
+ * @param onoff true: enable false: disable
+ * @return true: success, false: failure
+ */
+bool Adafruit_FONA::enableNetworkTimeSync(bool onoff) {
+  if (onoff) {
+    if (!sendCheckReply(F("AT+CLTS=1"), ok_reply))
+      return false;
+  } else {
+    if (!sendCheckReply(F("AT+CLTS=0"), ok_reply))
+      return false;
+  }
+
+  flushInput(); // eat any 'Unsolicted Result Code'
+
+  return true;
+}
+
+/**
+ * @brief Enable NTP time sync
+ *
+ * @param onoff true: enable false: disable
+ * @param ntpserver The NTP server buffer
+ * @return true: success, false: failure
+ */
+bool Adafruit_FONA::enableNTPTimeSync(bool onoff,
+                                      FONAFlashStringPtr ntpserver) {
+  if (onoff) {
+    if (!sendCheckReply(F("AT+CNTPCID=1"), ok_reply))
+      return false;
+
+    mySerial->print(F("AT+CNTP=\""));
+    if (ntpserver != 0) {
+      mySerial->print(ntpserver);
+    } else {
+      mySerial->print(F("pool.ntp.org"));
+    }
+    mySerial->println(F("\",0"));
+    readline(FONA_DEFAULT_TIMEOUT_MS);
+    if (strcmp(replybuffer, "OK") != 0)
+      return false;
+
+    if (!sendCheckReply(F("AT+CNTP"), ok_reply, 10000))
+      return false;
+
+    uint16_t status;
+    readline(10000);
+    if (!parseReply(F("+CNTP:"), &status))
+      return false;
+  } else {
+    if (!sendCheckReply(F("AT+CNTPCID=0"), ok_reply))
+      return false;
+  }
+
+  return true;
+}
 
 /**
  * @brief Get the current time
@@ -1236,300 +1851,292 @@ uint8_t Adafruit_FONA::getGPS(uint8_t arg, char* buffer, uint8_t maxbuff) {
 }
 
 /**
- * @brief Get a GPS reading
+ * @brief Parse two decimal digits of a date or time
  *
- * @param lat  Pointer to a buffer to be filled with thelatitude
- * @param lon Pointer to a buffer to be filled with the longitude
- * @param speed_kph Pointer to a buffer to be filled with the speed in
- * kilometers per hour
- * @param heading Pointer to a buffer to be filled with the heading
- * @param altitude Pointer to a buffer to be filled with the altitude
- * @return true: success, false: failure
+ * @param s The digits
+ * @return uint8_t Their value
  */
-bool Adafruit_FONA::getGPS(float* lat, float* lon, float* speed_kph,
-                           float* heading, float* altitude) {
-  char gpsbuffer[120];
+static uint8_t parseTwoDigits(const char* s) {
+  return (s[0] - '0') * 10 + (s[1] - '0');
+}
 
-  // we need at least a 2D fix
-  if (GPSstatus() < 2)
-    return false;
+/**
+ * @brief Read everything the module knows about the current fix with a
+ * single command: AT+CGNSINF on the 808 V2, AT+CGPSINFO on the 3G and
+ * AT+CGPSINF=32 on the 808 V1. Fields the module does not report are left 0.
+ *
+ * @param fix The fix to fill; fix->valid tells whether there is a fix
+ * @return true: success, false: no reply from the GPS
+ */
+bool Adafruit_FONA::readFix(FONAGnssFix* fix) {
+  memset(fix, 0, sizeof(*fix));
+  fix->mode = FONA_GNSS_FIX_NONE;
 
-  // grab the mode 2^5 gps csv from the sim808
-  uint8_t res_len = getGPS(32, gpsbuffer, 120);
+  FONAFlashStringPtr prefix;
+  if ((_type == FONA3G_A) || (_type == FONA3G_E)) {
+    getReply(F("AT+CGPSINFO"));
+    prefix = F("+CGPSINFO:");
+  } else if (_type == FONA808_V1) {
+    getReply(F("AT+CGPSINF=32"));
+    prefix = F("+CGPSINF: ");
+  } else {
+    getReply(F("AT+CGNSINF"));
+    prefix = F("+CGNSINF: ");
+  }
 
-  // make sure we have a response
-  if (res_len == 0)
+  char* p = prog_char_strstr(replybuffer, (prog_char*)prefix);
+  if (p == 0)
     return false;
+  p += prog_char_strlen((prog_char*)prefix);
+  while (*p == ' ')
+    p++;
 
-  if (_type == FONA3G_A || _type == FONA3G_E) {
-    // Parse 3G respose
-    // +CGPSINFO:4043.000000,N,07400.000000,W,151015,203802.1,-12.0,0.0,0
-    // skip beginning
-
-    // grab the latitude
-    char* latp = strtok(gpsbuffer, ",");
-    if (!latp)
-      return false;
-
-    // grab latitude direction
-    char* latdir = strtok(NULL, ",");
-    if (!latdir)
-      return false;
-
-    // grab longitude
-    char* longp = strtok(NULL, ",");
-    if (!longp)
-      return false;
-
-    // grab longitude direction
-    char* longdir = strtok(NULL, ",");
-    if (!longdir)
-      return false;
-
-    // skip date & time
-    (void)strtok(NULL, ",");
-    (void)strtok(NULL, ",");
-
-    // only grab altitude if needed
-    if (altitude != NULL) {
-      // grab altitude
-      char* altp = strtok(NULL, ",");
-      if (!altp)
-        return false;
-      *altitude = atof(altp);
-    }
-
-    // only grab speed if needed
-    if (speed_kph != NULL) {
-      // grab the speed in km/h
-      char* speedp = strtok(NULL, ",");
-      if (!speedp)
-        return false;
-
-      *speed_kph = atof(speedp);
-    }
-
-    // only grab heading if needed
-    if (heading != NULL) {
-      // grab the speed in knots
-      char* coursep = strtok(NULL, ",");
-      if (!coursep)
-        return false;
-
-      *heading = atof(coursep);
-    }
-
-    double latitude = atof(latp);
-    double longitude = atof(longp);
-
-    // convert latitude from minutes to decimal
-    float degrees = floor(latitude / 100);
-    double minutes = latitude - (100 * degrees);
-    minutes /= 60;
-    degrees += minutes;
-
-    // turn direction into + or -
-    if (latdir[0] == 'S')
-      degrees *= -1;
-
-    *lat = degrees;
-
-    // convert longitude from minutes to decimal
-    degrees = floor(longitude / 100);
-    minutes = longitude - (100 * degrees);
-    minutes /= 60;
-    degrees += minutes;
-
-    // turn direction into + or -
-    if (longdir[0] == 'W')
-      degrees *= -1;
-
-    *lon = degrees;
-
-  } else if (_type == FONA808_V2) {
-    // Parse 808 V2 response.  See table 2-3 from here for format:
-    // http://www.adafruit.com/datasheets/SIM800%20Series_GNSS_Application%20Note%20V1.00.pdf
-
-    // skip GPS run status
-    char* tok = strtok(gpsbuffer, ",");
-    if (!tok)
-      return false;
-
-    // skip fix status
-    tok = strtok(NULL, ",");
-    if (!tok)
-      return false;
-
-    // skip date
-    tok = strtok(NULL, ",");
-    if (!tok)
-      return false;
-
-    // grab the latitude
-    char* latp = strtok(NULL, ",");
-    if (!latp)
-      return false;
-
-    // grab longitude
-    char* longp = strtok(NULL, ",");
-    if (!longp)
-      return false;
-
-    *lat = atof(latp);
-    *lon = atof(longp);
-
-    // only grab altitude if needed
-    if (altitude != NULL) {
-      // grab altitude
-      char* altp = strtok(NULL, ",");
-      if (!altp)
-        return false;
-
-      *altitude = atof(altp);
-    }
-
-    // only grab speed if needed
-    if (speed_kph != NULL) {
-      // grab the speed in km/h
-      char* speedp = strtok(NULL, ",");
-      if (!speedp)
-        return false;
+  int32_t v;
+  char* lat = 0;
+  char* lon = 0;
 
-      *speed_kph = atof(speedp);
+  if ((_type == FONA3G_A) || (_type == FONA3G_E)) {
+    // 4043.000000,N,07400.000000,W,151015,203802.1,-12.0,0.0,0
+    for (uint8_t i = 0; *p; i++) {
+      char* f = nextField(&p);
+      switch (i) {
+        case 0:
+          lat = f;
+          break;
+        case 1:
+          fix->valid = FONAparseNMEACoord(lat, f[0], &fix->lat_udeg);
+          break;
+        case 2:
+          lon = f;
+          break;
+        case 3:
+          fix->valid &= FONAparseNMEACoord(lon, f[0], &fix->lon_udeg);
+          break;
+        case 4:
+          if (strlen(f) == 6) {
+            fix->day = parseTwoDigits(f);
+            fix->month = parseTwoDigits(f + 2);
+            fix->year = parseTwoDigits(f + 4);
+          }
+          break;
+        case 5:
+          if (strlen(f) >= 6) {
+            fix->hour = parseTwoDigits(f);
+            fix->minute = parseTwoDigits(f + 2);
+            fix->second = parseTwoDigits(f + 4);
+          }
+          break;
+        case 6:
+          if (FONAparseFixed(f, 2, &v))
+            fix->alt_cm = v;
+          break;
+        case 7:
+          // knots
+          if (FONAparseFixed(f, 3, &v))
+            fix->speed_cmps = ((uint32_t)v * 1852 + 18000) / 36000;
+          break;
+        case 8:
+          if (FONAparseFixed(f, 2, &v))
+            fix->course_cdeg = v;
+          break;
+      }
     }
-
-    // only grab heading if needed
-    if (heading != NULL) {
-      // grab the speed in knots
-      char* coursep = strtok(NULL, ",");
-      if (!coursep)
-        return false;
-
-      *heading = atof(coursep);
+    if (fix->valid)
+      fix->mode = FONA_GNSS_FIX_3D;
+  } else if (_type == FONA808_V1) {
+    // 32,203802.000,A,4043.0000,N,07400.0000,W,0.00,0.00,151015,,,A
+    for (uint8_t i = 0; *p; i++) {
+      char* f = nextField(&p);
+      switch (i) {
+        case 1:
+          if (strlen(f) >= 6) {
+            fix->hour = parseTwoDigits(f);
+            fix->minute = parseTwoDigits(f + 2);
+            fix->second = parseTwoDigits(f + 4);
+          }
+          break;
+        case 2:
+          fix->valid = (f[0] == 'A');
+          break;
+        case 3:
+          lat = f;
+          break;
+        case 4:
+          FONAparseNMEACoord(lat, f[0], &fix->lat_udeg);
+          break;
+        case 5:
+          lon = f;
+          break;
+        case 6:
+          FONAparseNMEACoord(lon, f[0], &fix->lon_udeg);
+          break;
+        case 7:
+          // knots
+          if (FONAparseFixed(f, 3, &v))
+            fix->speed_cmps = ((uint32_t)v * 1852 + 18000) / 36000;
+          break;
+        case 8:
+          if (FONAparseFixed(f, 2, &v))
+            fix->course_cdeg = v;
+          break;
+        case 9:
+          if (strlen(f) == 6) {
+            fix->day = parseTwoDigits(f);
+            fix->month = parseTwoDigits(f + 2);
+            fix->year = parseTwoDigits(f + 4);
+          }
+          break;
+      }
     }
+    // RMC carries no fix dimension
+    if (fix->valid)
+      fix->mode = FONA_GNSS_FIX_2D;
   } else {
-    // Parse 808 V1 response.
-
-    // skip mode
-    char* tok = strtok(gpsbuffer, ",");
-    if (!tok)
-      return false;
-
-    // skip date
-    tok = strtok(NULL, ",");
-    if (!tok)
-      return false;
-
-    // skip fix
-    tok = strtok(NULL, ",");
-    if (!tok)
-      return false;
-
-    // grab the latitude
-    char* latp = strtok(NULL, ",");
-    if (!latp)
-      return false;
-
-    // grab latitude direction
-    char* latdir = strtok(NULL, ",");
-    if (!latdir)
-      return false;
-
-    // grab longitude
-    char* longp = strtok(NULL, ",");
-    if (!longp)
-      return false;
-
-    // grab longitude direction
-    char* longdir = strtok(NULL, ",");
-    if (!longdir)
-      return false;
-
-    double latitude = atof(latp);
-    double longitude = atof(longp);
-
-    // convert latitude from minutes to decimal
-    float degrees = floor(latitude / 100);
-    double minutes = latitude - (100 * degrees);
-    minutes /= 60;
-    degrees += minutes;
-
-    // turn direction into + or -
-    if (latdir[0] == 'S')
-      degrees *= -1;
-
-    *lat = degrees;
-
-    // convert longitude from minutes to decimal
-    degrees = floor(longitude / 100);
-    minutes = longitude - (100 * degrees);
-    minutes /= 60;
-    degrees += minutes;
-
-    // turn direction into + or -
-    if (longdir[0] == 'W')
-      degrees *= -1;
-
-    *lon = degrees;
+    // run,fix,UTC,lat,lon,alt,speed,course,mode,,HDOP,PDOP,VDOP,,in view,used
+    // 1,1,20151015203802.000,40.716667,-74.000000,12.0,0.00,0.0,1,,1.1,...
+    for (uint8_t i = 0; *p; i++) {
+      char* f = nextField(&p);
+      switch (i) {
+        case 1:
+          fix->valid = (f[0] == '1');
+          break;
+        case 2:
+          if (strlen(f) >= 14) {
+            fix->year = parseTwoDigits(f + 2);
+            fix->month = parseTwoDigits(f + 4);
+            fix->day = parseTwoDigits(f + 6);
+            fix->hour = parseTwoDigits(f + 8);
+            fix->minute = parseTwoDigits(f + 10);
+            fix->second = parseTwoDigits(f + 12);
+          }
+          break;
+        case 3:
+          if (FONAparseFixed(f, 6, &v))
+            fix->lat_udeg = v;
+          break;
+        case 4:
+          if (FONAparseFixed(f, 6, &v))
+            fix->lon_udeg = v;
+          break;
+        case 5:
+          if (FONAparseFixed(f, 2, &v))
+            fix->alt_cm = v;
+          break;
+        case 6:
+          // km/h
+          if (FONAparseFixed(f, 2, &v))
+            fix->speed_cmps = ((uint32_t)v * 10 + 18) / 36;
+          break;
+        case 7:
+          if (FONAparseFixed(f, 2, &v))
+            fix->course_cdeg = v;
+          break;
+        case 10:
+          if (FONAparseFixed(f, 2, &v))
+            fix->hdop = v;
+          break;
+        case 15:
+          fix->sats = atoi(f);
+          break;
+      }
+    }
+    // no 2D/3D status either, so assume a fix is 3D like GPSstatus()
+    if (fix->valid)
+      fix->mode = FONA_GNSS_FIX_3D;
+  }
 
-    // only grab speed if needed
-    if (speed_kph != NULL) {
-      // grab the speed in knots
-      char* speedp = strtok(NULL, ",");
-      if (!speedp)
-        return false;
+  readline(); // eat 'OK'
+  return true;
+}
 
-      // convert to kph
-      *speed_kph = atof(speedp) * 1.852;
-    }
+/**
+ * @brief Get a GPS reading in integer units, without the float maths and
+ * strtok() of the float version
+ *
+ * @param lat_udeg Pointer to an int32_t to be filled with the latitude in
+ * microdegrees
+ * @param lon_udeg Pointer to an int32_t to be filled with the longitude in
+ * microdegrees
+ * @param speed_cmps Pointer to a uint16_t to be filled with the speed in cm/s
+ * @param course_cdeg Pointer to a uint16_t to be filled with the heading in
+ * 1/100 degree
+ * @param alt_cm Pointer to an int32_t to be filled with the altitude in cm
+ * @return true: success, false: failure
+ */
+bool Adafruit_FONA::getGPS(int32_t* lat_udeg, int32_t* lon_udeg,
+                           uint16_t* speed_cmps, uint16_t* course_cdeg,
+                           int32_t* alt_cm) {
+  FONAGnssFix fix;
 
-    // only grab heading if needed
-    if (heading != NULL) {
-      // grab the speed in knots
-      char* coursep = strtok(NULL, ",");
-      if (!coursep)
-        return false;
+  if (!readFix(&fix) || !fix.valid)
+    return false;
 
-      *heading = atof(coursep);
-    }
+  *lat_udeg = fix.lat_udeg;
+  *lon_udeg = fix.lon_udeg;
+  if (speed_cmps != NULL)
+    *speed_cmps = fix.speed_cmps;
+  if (course_cdeg != NULL)
+    *course_cdeg = fix.course_cdeg;
 
-    // no need to continue
-    if (altitude == NULL)
-      return true;
+  // no need to continue
+  if (alt_cm == NULL)
+    return true;
 
-    // we need at least a 3D fix for altitude
-    if (GPSstatus() < 3)
-      return false;
+  if (_type != FONA808_V1) {
+    *alt_cm = fix.alt_cm;
+    return true;
+  }
 
-    // grab the mode 0 gps csv from the sim808
-    res_len = getGPS(0, gpsbuffer, 120);
+  // the 808 V1 only reports altitude in the mode 0 reading
+  // +CGPSINF: 0,4043.0000,07400.0000,12.000000,20151015203802.000,...
+  getReply(F("AT+CGPSINF=0"));
+  char* p = prog_char_strstr(replybuffer, (prog_char*)F("+CGPSINF: "));
+  if (p == 0)
+    return false;
+  p += 10;
 
-    // make sure we have a response
-    if (res_len == 0)
-      return false;
+  // skip mode, lat and long
+  for (uint8_t i = 0; i < 3; i++)
+    nextField(&p);
 
-    // skip mode
-    tok = strtok(gpsbuffer, ",");
-    if (!tok)
-      return false;
+  int32_t v;
+  bool ok = FONAparseFixed(nextField(&p), 2, &v);
+  readline(); // eat 'OK'
+  if (!ok)
+    return false;
 
-    // skip lat
-    tok = strtok(NULL, ",");
-    if (!tok)
-      return false;
+  *alt_cm = v;
+  return true;
+}
 
-    // skip long
-    tok = strtok(NULL, ",");
-    if (!tok)
-      return false;
+/**
+ * @brief Get a GPS reading
+ *
+ * @param lat  Pointer to a buffer to be filled with thelatitude
+ * @param lon Pointer to a buffer to be filled with the longitude
+ * @param speed_kph Pointer to a buffer to be filled with the speed in
+ * kilometers per hour
+ * @param heading Pointer to a buffer to be filled with the heading
+ * @param altitude Pointer to a buffer to be filled with the altitude
+ * @return true: success, false: failure
+ */
+bool Adafruit_FONA::getGPS(float* lat, float* lon, float* speed_kph,
+                           float* heading, float* altitude) {
+  int32_t lat_udeg, lon_udeg, alt_cm;
+  uint16_t speed_cmps, course_cdeg;
 
-    // grab altitude
-    char* altp = strtok(NULL, ",");
-    if (!altp)
-      return false;
+  if (!getGPS(&lat_udeg, &lon_udeg, &speed_cmps, &course_cdeg,
+              altitude ? &alt_cm : 0))
+    return false;
 
-    *altitude = atof(altp);
-  }
+  *lat = lat_udeg / 1000000.0;
+  *lon = lon_udeg / 1000000.0;
+  if (speed_kph != NULL)
+    *speed_kph = speed_cmps * 0.036;
+  if (heading != NULL)
+    *heading = course_cdeg / 100.0;
+  if (altitude != NULL)
+    *altitude = alt_cm / 100.0;
 
   return true;
 }
@@ -1566,6 +2173,114 @@ bool Adafruit_FONA::enableGPSNMEA(uint8_t enable_value) {
   }
 }
 
+/**
+ * @brief Restart the GNSS engine, keeping as much of what it knows as the
+ * mode allows
+ *
+ * @param mode FONA_GPS_HOT: keep time, position, almanac and ephemeris,
+ * FONA_GPS_WARM: drop the ephemeris, FONA_GPS_COLD: drop everything. The 3G
+ * has no warm start, so warm does a hot start there.
+ * @return true: success, false: failure
+ */
+bool Adafruit_FONA::GPSrestart(uint8_t mode) {
+  if (mode > FONA_GPS_WARM)
+    return false;
+
+  if ((_type == FONA3G_A) || (_type == FONA3G_E)) {
+    if (mode == FONA_GPS_COLD)
+      return sendCheckReply(F("AT+CGPSCOLD"), ok_reply);
+    return sendCheckReply(F("AT+CGPSHOT"), ok_reply);
+  } else if (_type == FONA808_V1) {
+    return sendCheckReply(F("AT+CGPSRST="), mode, ok_reply);
+  } else if (_type == FONA808_V2) {
+    return sendCheckReply(F("AT+CGNSRST="), mode, ok_reply);
+  }
+  return false;
+}
+
+/**
+ * @brief Download GPS assistance data over GPRS, so the next start gets a
+ * fix in seconds instead of minutes. On the 808 V2 the EPO file at url is
+ * stored with AT+HTTPTOFS and checked with AT+CGNSCHK; call
+ * enableGPSAssist() once GPS is on to use it. The 3G downloads XTRA data
+ * from its own server with AT+CGPSXD and uses it by itself. GPRS must be
+ * enabled, and the module clock set, e.g. with enableNTPTimeSync().
+ *
+ * @param url Pointer to a buffer with the EPO URL, e.g. FONA_GPS_EPO_URL.
+ * Unused on the 3G.
+ * @param status Pointer to a uint16_t to hold the HTTP status of the
+ * download, 200 on the 3G
+ * @param datalen Pointer to a uint32_t to hold the size of the data, 0 on
+ * the 3G
+ * @return true: success, false: failure
+ */
+bool Adafruit_FONA::downloadGPSAssist(char* url, uint16_t* status,
+                                      uint32_t* datalen) {
+  *status = 0;
+  *datalen = 0;
+
+  if ((_type == FONA3G_A) || (_type == FONA3G_E)) {
+    if (!sendCheckReply(F("AT+CGPSXE=1"), ok_reply))
+      return false;
+    if (!sendCheckReply(F("AT+CGPSXD=0"), ok_reply))
+      return false;
+
+    // +CGPSXD: 0 once the download succeeded
+    uint16_t result;
+    readline(60000);
+    if (!parseReply(F("+CGPSXD: "), &result) || (result != 0))
+      return false;
+    *status = 200;
+    return true;
+  }
+
+  if (_type != FONA808_V2)
+    return false;
+
+  // AT+HTTPTOFS takes the URL itself, but needs the HTTP session on the
+  // GPRS bearer
+  bool ok = HTTP_setup(url);
+  if (ok) {
+    DEBUG_PRINT(F("\t---> "));
+    DEBUG_PRINT(F("AT+HTTPTOFS=\""));
+    DEBUG_PRINT(url);
+    DEBUG_PRINTLN(F("\",\"" FONA_GPS_EPO_FILE "\""));
+
+    mySerial->print(F("AT+HTTPTOFS=\""));
+    mySerial->print(url);
+    mySerial->println(F("\",\"" FONA_GPS_EPO_FILE "\""));
+    ok = expectReply(ok_reply);
+  }
+
+  if (ok) {
+    // +HTTPTOFS: <status>,<length> once the file is written
+    readline(60000);
+    ok = parseReply(F("+HTTPTOFS: "), status, ',', 0) &&
+         parseReply(F("+HTTPTOFS: "), datalen, ',', 1) && (*status == 200);
+  }
+
+  // close the HTTP session on every path, unless the caller keeps one open
+  HTTP_GET_end();
+
+  return ok && sendCheckReply(F("AT+CGNSCHK=3,1"), ok_reply, 10000);
+}
+
+/**
+ * @brief Hand the downloaded assistance data to the GNSS engine. Call it
+ * after enableGPS(true); on the 808 V2 this sends the EPO file with
+ * AT+CGNSAID, on the 3G the XTRA data is already in use.
+ *
+ * @return true: success, false: failure
+ */
+bool Adafruit_FONA::enableGPSAssist(void) {
+  if ((_type == FONA3G_A) || (_type == FONA3G_E))
+    return true;
+  if (_type != FONA808_V2)
+    return false;
+
+  return sendCheckReply(F("AT+CGNSAID=31,1,1"), ok_reply, 10000);
+}
+
 /********* GPRS **********************************************************/
 
 /**
@@ -1789,37 +2504,55 @@ bool Adafruit_FONA::getGSMLoc(uint16_t* errorcode, char* buff,
 }
 
 /**
- * @brief Get GSM Location
+ * @brief Get GSM location in microdegrees, without the float maths and
+ * strtok() of the float version
  *
- * @param lat Pointer to a buffer to hold the latitude
- * @param lon Pointer to a buffer to hold the longitude
+ * @param lat_udeg Pointer to an int32_t to hold the latitude
+ * @param lon_udeg Pointer to an int32_t to hold the longitude
  * @return true: success, false: failure
  */
-bool Adafruit_FONA::getGSMLoc(float* lat, float* lon) {
+bool Adafruit_FONA::getGSMLoc(int32_t* lat_udeg, int32_t* lon_udeg) {
   uint16_t returncode;
-  char gpsbuffer[120];
 
-  // make sure we could get a response
-  if (!getGSMLoc(&returncode, gpsbuffer, 120))
-    return false;
+  getReply(F("AT+CIPGSMLOC=1,1"), (uint16_t)10000);
 
-  // make sure we have a valid return code
-  if (returncode != 0)
+  if (!parseReply(F("+CIPGSMLOC: "), &returncode))
     return false;
 
   // +CIPGSMLOC: 0,-74.007729,40.730160,2015/10/15,19:24:55
-  // tokenize the gps buffer to locate the lat & long
-  char* longp = strtok(gpsbuffer, ",");
-  if (!longp)
-    return false;
+  int32_t lat, lon;
+  char* p = strchr(replybuffer, ',');
+  bool ok = (returncode == 0) && p && FONAparseFixed(p + 1, 6, &lon);
+  if (ok) {
+    p = strchr(p + 1, ',');
+    ok = p && FONAparseFixed(p + 1, 6, &lat);
+  }
+
+  readline(); // eat OK
 
-  char* latp = strtok(NULL, ",");
-  if (!latp)
+  if (!ok)
     return false;
 
-  *lat = atof(latp);
-  *lon = atof(longp);
+  *lat_udeg = lat;
+  *lon_udeg = lon;
+  return true;
+}
+
+/**
+ * @brief Get GSM Location
+ *
+ * @param lat Pointer to a buffer to hold the latitude
+ * @param lon Pointer to a buffer to hold the longitude
+ * @return true: success, false: failure
+ */
+bool Adafruit_FONA::getGSMLoc(float* lat, float* lon) {
+  int32_t lat_udeg, lon_udeg;
 
+  if (!getGSMLoc(&lat_udeg, &lon_udeg))
+    return false;
+
+  *lat = lat_udeg / 1000000.0;
+  *lon = lon_udeg / 1000000.0;
   return true;
 }
 /********* TCP FUNCTIONS  ************************************/
@@ -1927,6 +2660,9 @@ bool Adafruit_FONA::TCPsend(char* data, uint8_t len) {
   DEBUG_PRINT(F("\t<--- "));
   DEBUG_PRINTLN(replybuffer);
 
+  // the link may have dropped while we were waiting ("CLOSED")
+  handleURC(replybuffer);
+
   return (strcmp(replybuffer, "SEND OK") == 0);
 }
 /**
@@ -1978,6 +2714,82 @@ uint16_t Adafruit_FONA::TCPread(uint8_t* buff, uint8_t len) {
   return avail;
 }
 
+/**
+ * @brief Configure TCP keepalive probes for connections opened afterwards.
+ * Lets the module notice a half-open link (e.g. dropped by a carrier NAT)
+ * and report it with a "CLOSED" URC instead of waiting for a send to fail.
+ *
+ * @param onoff true: enable false: disable
+ * @param idle Idle time before the first probe, in seconds (30-7200)
+ * @param interval Time between probes, in seconds (30-600)
+ * @param count Number of unanswered probes before closing (1-9)
+ * @return true: success, false: failure
+ */
+bool Adafruit_FONA::TCPkeepalive(bool onoff, uint16_t idle, uint16_t interval,
+                                 uint8_t count) {
+  if (!onoff)
+    return sendCheckReply(F("AT+CIPTKA=0"), ok_reply);
+
+  flushInput();
+
+  DEBUG_PRINT(F("\t---> "));
+  DEBUG_PRINT(F("AT+CIPTKA=1,"));
+  DEBUG_PRINT(idle);
+  DEBUG_PRINT(',');
+  DEBUG_PRINT(interval);
+  DEBUG_PRINT(',');
+  DEBUG_PRINTLN(count);
+
+  mySerial->print(F("AT+CIPTKA=1,"));
+  mySerial->print(idle);
+  mySerial->print(',');
+  mySerial->print(interval);
+  mySerial->print(',');
+  mySerial->println(count);
+
+  return expectReply(ok_reply);
+}
+
+/********* UNSOLICITED RESULT CODES *************************************/
+
+/**
+ * @brief Check for unsolicited result codes from the module.
+ *
+ * Reads any complete lines waiting on the serial port and returns the events
+ * seen since the last call, including those spotted while other commands
+ * flushed their input. Only the events in the mask are returned and
+ * cleared, so each user can take its own without losing the others'.
+ *
+ * @param timeout How long to wait for an event, in milliseconds. 0 only
+ * handles what is already buffered.
+ * @param mask The FONA_URC_* events to check for
+ * @return uint8_t Bitmask of FONA_URC_* events, 0 if nothing happened
+ */
+uint8_t Adafruit_FONA::pollURC(uint16_t timeout, uint8_t mask) {
+  do {
+    readURCs();
+    if ((urcflags & mask) || !timeout)
+      break;
+    delay(1);
+  } while (--timeout);
+
+  uint8_t flags = urcflags & mask;
+  urcflags &= ~mask;
+  return flags;
+}
+
+/**
+ * @brief Handle the complete lines waiting on the serial port as unsolicited
+ * result codes
+ *
+ */
+void Adafruit_FONA::readURCs(void) {
+  while (available()) {
+    if (readline(100))
+      handleURC(replybuffer);
+  }
+}
+
 /********* HTTP LOW LEVEL FUNCTIONS  ************************************/
 
 /**
@@ -1986,7 +2798,11 @@ uint16_t Adafruit_FONA::TCPread(uint8_t* buff, uint8_t len) {
  * @return true: success, false: failure
  */
 bool Adafruit_FONA::HTTP_init() {
-  return sendCheckReply(F("AT+HTTPINIT"), ok_reply);
+  httpcache = 0;
+  if (!sendCheckReply(F("AT+HTTPINIT"), ok_reply))
+    return false;
+  httpcache = FONA_HTTP_CACHE_INIT;
+  return true;
 }
 
 /**
@@ -1995,6 +2811,7 @@ bool Adafruit_FONA::HTTP_init() {
  * @return true: success, false: failure
  */
 bool Adafruit_FONA::HTTP_term() {
+  httpcache = 0;
   return sendCheckReply(F("AT+HTTPTERM"), ok_reply);
 }
 
@@ -2117,6 +2934,31 @@ bool Adafruit_FONA::HTTP_data(uint32_t size, uint32_t maxTime) {
  */
 bool Adafruit_FONA::HTTP_action(uint8_t method, uint16_t* status,
                                 uint16_t* datalen, int32_t timeout) {
+  uint32_t len;
+
+  if (!HTTP_action(method, status, &len, timeout))
+    return false;
+
+  *datalen = (len > 0xFFFF) ? 0xFFFF : len;
+  return true;
+}
+
+/**
+ * @brief Make an HTTP Request, reporting the full 32-bit response length
+ *
+ * @param method The request method:
+ * * 0: GET
+ * * 1: POST
+ * * 2: HEAD
+ * @param status Pointer to a uint16_t to hold the request status as an RFC2616
+ * HTTP response code: https://en.wikipedia.org/wiki/List_of_HTTP_status_codes
+ * @param datalen Pointer to a `uint32_t` to hold the length of the response
+ * body
+ * @param timeout Timeout for waiting for response
+ * @return true: success, false: failure
+ */
+bool Adafruit_FONA::HTTP_action(uint8_t method, uint16_t* status,
+                                uint32_t* datalen, int32_t timeout) {
   // Send request.
   if (!sendCheckReply(F("AT+HTTPACTION="), method, ok_reply))
     return false;
@@ -2128,32 +2970,297 @@ bool Adafruit_FONA::HTTP_action(uint8_t method, uint16_t* status,
   if (!parseReply(F("+HTTPACTION:"), datalen, ',', 2))
     return false;
 
-  return true;
+  return true;
+}
+
+/**
+ * @brief Start an HTTP Request without waiting for the response. Returns as
+ * soon as the module accepts the command; use HTTP_action_poll() to collect
+ * the result from the +HTTPACTION URC.
+ *
+ * @param method The request method:
+ * * 0: GET
+ * * 1: POST
+ * * 2: HEAD
+ * @param timeout How long HTTP_action_poll() waits for the result before
+ * giving up, in milliseconds
+ * @return true: success, false: failure
+ */
+bool Adafruit_FONA::HTTP_action_start(uint8_t method, uint32_t timeout) {
+  httpactionstate = FONA_HTTP_ACTION_IDLE;
+
+  if (!sendCheckReply(F("AT+HTTPACTION="), method, ok_reply))
+    return false;
+
+  httpactionstate = FONA_HTTP_ACTION_PENDING;
+  httpactionstart = millis();
+  httpactionwait = timeout;
+  return true;
+}
+
+/**
+ * @brief Check whether a request started with HTTP_action_start() finished
+ *
+ * @param status Pointer to a uint16_t to hold the request status as an RFC2616
+ * HTTP response code: https://en.wikipedia.org/wiki/List_of_HTTP_status_codes
+ * @param datalen Pointer to a `uint32_t` to hold the length of the response
+ * body
+ * @return int8_t 1: finished, status and datalen are set, 0: still pending,
+ * -1: timed out or no request was started
+ */
+int8_t Adafruit_FONA::HTTP_action_poll(uint16_t* status, uint32_t* datalen) {
+  readURCs();
+
+  if (httpactionstate == FONA_HTTP_ACTION_DONE) {
+    httpactionstate = FONA_HTTP_ACTION_IDLE;
+    *status = httpactionstatus;
+    *datalen = httpactionlen;
+    return 1;
+  }
+
+  if (httpactionstate != FONA_HTTP_ACTION_PENDING)
+    return -1;
+
+  if ((uint32_t)(millis() - httpactionstart) >= httpactionwait) {
+    httpactionstate = FONA_HTTP_ACTION_IDLE;
+    return -1;
+  }
+
+  return 0;
+}
+
+/**
+ * @brief Read all available HTTP data
+ *
+ * @param datalen Pointer to the  a `uint16_t` to hold the length of the data
+ * read
+ * @return true: success, false: failure
+ */
+bool Adafruit_FONA::HTTP_readall(uint16_t* datalen) {
+  getReply(F("AT+HTTPREAD"));
+  if (!parseReply(F("+HTTPREAD:"), datalen, ',', 0))
+    return false;
+
+  return true;
+}
+
+/**
+ * @brief Read one window of the HTTP response body straight into a buffer
+ *
+ * @param offset Offset of the first byte to read within the body
+ * @param buff Pointer to a buffer to hold the data
+ * @param len The maximum number of bytes to read
+ * @return uint16_t The number of bytes read, 0 at the end of the body or on
+ * failure
+ */
+uint16_t Adafruit_FONA::HTTP_read(uint32_t offset, uint8_t* buff,
+                                  uint16_t len) {
+  flushInput();
+
+  DEBUG_PRINT(F("\t---> "));
+  DEBUG_PRINT(F("AT+HTTPREAD="));
+  DEBUG_PRINT(offset);
+  DEBUG_PRINT(',');
+  DEBUG_PRINTLN(len);
+
+  mySerial->print(F("AT+HTTPREAD="));
+  mySerial->print(offset);
+  mySerial->print(',');
+  mySerial->println(len);
+
+  // +HTTPREAD: <n> is followed by exactly n bytes of data, then OK
+  readline(1000);
+
+  DEBUG_PRINT(F("\t<--- "));
+  DEBUG_PRINTLN(replybuffer);
+
+  uint16_t avail;
+  if (!parseReply(F("+HTTPREAD:"), &avail))
+    return 0;
+  if (avail > len)
+    avail = len;
+
+  avail = readRaw(buff, avail, 1000);
+  expectReply(ok_reply, 1000);
+
+  return avail;
+}
+
+/**
+ * @brief Read the whole HTTP response body in windows of bufflen bytes,
+ * handing each one to a callback. Works for bodies larger than 64 KB while
+ * only needing RAM for one window.
+ *
+ * @param datalen The body length reported by HTTP_action()
+ * @param callback Function called with each chunk, returns false to stop
+ * @param context Pointer passed through to the callback
+ * @param buff Pointer to a buffer to hold one window
+ * @param bufflen The size of the window buffer
+ * @return true: the whole body was read, false: failure or stopped by the
+ * callback
+ */
+bool Adafruit_FONA::HTTP_readStream(uint32_t datalen,
+                                    FONAHTTPReadCallback callback,
+                                    void* context, uint8_t* buff,
+                                    uint16_t bufflen) {
+  uint32_t offset = 0;
+
+  while (offset < datalen) {
+    uint16_t want = bufflen;
+    if (datalen - offset < want)
+      want = datalen - offset;
+
+    uint16_t got = HTTP_read(offset, buff, want);
+    if (got == 0)
+      return false;
+    if (!callback(buff, got, offset, context))
+      return false;
+
+    offset += got;
+  }
+
+  return true;
+}
+
+/**
+ * @brief Enable or disable SSL
+ *
+ * @param onoff true: enable false: disable
+ * @return true: success, false: failure
+ */
+bool Adafruit_FONA::HTTP_ssl(bool onoff) {
+  return sendCheckReply(F("AT+HTTPSSL="), onoff ? 1 : 0, ok_reply);
+}
+
+/********* HTTP HEADERS ****************************************/
+
+/**
+ * @brief Add a custom header (e.g. Authorization, If-None-Match) to the
+ * following requests. Headers are sent with HTTPPARA="USERDATA".
+ *
+ * @param name The header name, without the colon
+ * @param value Pointer to a buffer with the header value. Not copied, so it
+ * must stay valid until HTTP_clearHeaders() is called.
+ * @return true: success, false: FONA_HTTP_MAX_HEADERS are already queued
+ */
+bool Adafruit_FONA::HTTP_addHeader(FONAFlashStringPtr name,
+                                   const char* value) {
+  if (httpheaders >= FONA_HTTP_MAX_HEADERS)
+    return false;
+
+  httpheadername[httpheaders] = name;
+  httpheadervalue[httpheaders] = value;
+  httpheaders++;
+  return true;
+}
+
+/**
+ * @brief Remove all custom request headers
+ *
+ */
+void Adafruit_FONA::HTTP_clearHeaders(void) {
+  httpheaders = 0;
+}
+
+/**
+ * @brief Read the response headers of the last request with AT+HTTPHEAD
+ *
+ * @param buff Pointer to a buffer to hold the header block. It is NUL
+ * terminated, anything beyond maxlen - 1 bytes is dropped.
+ * @param maxlen The size of the buffer
+ * @return uint16_t The number of bytes stored, 0 on failure
+ */
+uint16_t Adafruit_FONA::HTTP_readHeaders(char* buff, uint16_t maxlen) {
+  if (maxlen == 0)
+    return 0;
+
+  getReply(F("AT+HTTPHEAD"), 1000);
+
+  uint32_t total;
+  if (!parseReply(F("+HTTPHEAD:"), &total))
+    return 0;
+
+  uint16_t len = (total < maxlen) ? total : maxlen - 1;
+  len = readRaw((uint8_t*)buff, len, 1000);
+  buff[len] = 0;
+
+  // drop what didn't fit, in reads readRaw() can count
+  total -= len;
+  while (total > 0) {
+    uint16_t n = (total > 0xFFFF) ? 0xFFFF : total;
+    if (readRaw(NULL, n, 1000) < n)
+      break;
+    total -= n;
+  }
+  expectReply(ok_reply, 1000);
+
+  return len;
 }
 
 /**
- * @brief Read all available HTTP data
- *
- * @param datalen Pointer to the  a `uint16_t` to hold the length of the data
- * read
- * @return true: success, false: failure
+ * @brief Step to the next header in a header block read by
+ * HTTP_readHeaders(). Lines without a colon, such as the status line, are
+ * skipped.
+ *
+ * @param p Pointer to the read position, advanced past the header found
+ * @param end Pointer to the end of the header block
+ * @param header Pointer to a FONAHTTPHeader to fill
+ * @return true: a header was found, false: no more headers
  */
-bool Adafruit_FONA::HTTP_readall(uint16_t* datalen) {
-  getReply(F("AT+HTTPREAD"));
-  if (!parseReply(F("+HTTPREAD:"), datalen, ',', 0))
-    return false;
+bool Adafruit_FONA::HTTP_nextHeader(const char** p, const char* end,
+                                    FONAHTTPHeader* header) {
+  while (*p < end) {
+    const char* line = *p;
+    const char* eol = line;
+    while ((eol < end) && (*eol != '\n'))
+      eol++;
+    *p = (eol < end) ? eol + 1 : end;
+
+    const char* colon = line;
+    while ((colon < eol) && (*colon != ':'))
+      colon++;
+    if (colon == eol)
+      continue;
 
-  return true;
+    const char* value = colon + 1;
+    while ((value < eol) && (*value == ' '))
+      value++;
+    const char* vend = eol;
+    while ((vend > value) &&
+           ((vend[-1] == '\r') || (vend[-1] == ' ') || (vend[-1] == '\t')))
+      vend--;
+
+    header->name = line;
+    header->namelen = colon - line;
+    header->value = value;
+    header->valuelen = vend - value;
+    return true;
+  }
+  return false;
 }
 
 /**
- * @brief Enable or disable SSL
- *
- * @param onoff true: enable false: disable
- * @return true: success, false: failure
+ * @brief Find a header by name (case insensitive) in a header block read by
+ * HTTP_readHeaders()
+ *
+ * @param headers Pointer to the header block
+ * @param len The length of the header block
+ * @param name The header name to look for
+ * @param header Pointer to a FONAHTTPHeader to fill
+ * @return true: found, false: not present
  */
-bool Adafruit_FONA::HTTP_ssl(bool onoff) {
-  return sendCheckReply(F("AT+HTTPSSL="), onoff ? 1 : 0, ok_reply);
+bool Adafruit_FONA::HTTP_findHeader(const char* headers, uint16_t len,
+                                    FONAFlashStringPtr name,
+                                    FONAHTTPHeader* header) {
+  const char* p = headers;
+  uint8_t namelen = prog_char_strlen((prog_char*)name);
+
+  while (HTTP_nextHeader(&p, headers + len, header)) {
+    if ((header->namelen == namelen) &&
+        (prog_char_strncasecmp(header->name, (prog_char*)name, namelen) == 0))
+      return true;
+  }
+  return false;
 }
 
 /********* HTTP HIGH LEVEL FUNCTIONS ***************************/
@@ -2190,48 +3297,205 @@ bool Adafruit_FONA::HTTP_GET_start(char* url, uint16_t* status,
   return true;
 }
 
-/*
-bool Adafruit_FONA_3G::HTTP_GET_start(char *ipaddr, char *path, uint16_t port
-                                      uint16_t *status, uint16_t *datalen){
-  char send[100] = "AT+CHTTPACT=\"";
-  char *sendp = send + strlen(send);
-  memset(sendp, 0, 100 - strlen(send));
+/**
+ * @brief Start a HTTP GET request, leaving the body on the module
+ *
+ * Unlike the 16-bit variant this doesn't issue a bare AT+HTTPREAD, so the
+ * body can be fetched in windows with HTTP_read() or HTTP_readStream().
+ *
+ * @param url Pointer to a buffer with the URL to request
+ * @param status Pointer to a uint16_t to hold the request status as an RFC2616
+ * HTTP response code: https://en.wikipedia.org/wiki/List_of_HTTP_status_codes
+ * @param datalen Pointer to a `uint32_t` to hold the length of the response
+ * body
+ * @return true: success, false: failure
+ */
+bool Adafruit_FONA::HTTP_GET_start(char* url, uint16_t* status,
+                                   uint32_t* datalen) {
+  if (!HTTP_setup(url))
+    return false;
 
-  strcpy(sendp, ipaddr);
-  sendp+=strlen(ipaddr);
-  sendp[0] = '\"';
-  sendp++;
-  sendp[0] = ',';
-  itoa(sendp, port);
-  getReply(send, 500);
+  // HTTP GET
+  if (!HTTP_action(FONA_HTTP_GET, status, datalen, 30000))
+    return false;
 
-  return;
+  DEBUG_PRINT(F("Status: "));
+  DEBUG_PRINTLN(*status);
+  DEBUG_PRINT(F("Len: "));
+  DEBUG_PRINTLN(*datalen);
 
-  if (! HTTP_setup(url))
+  return true;
+}
 
+/**
+ * @brief Start a HTTP GET request without waiting for the response. Poll
+ * with HTTP_action_poll(), then read the body with HTTP_read() or
+ * HTTP_readStream() and finish with HTTP_GET_end().
+ *
+ * @param url Pointer to a buffer with the URL to request
+ * @return true: success, false: failure
+ */
+bool Adafruit_FONA::HTTP_GET_async(char* url) {
+  if (!HTTP_setup(url))
     return false;
 
-  // HTTP GET
-  if (! HTTP_action(FONA_HTTP_GET, status, datalen))
-    return false;
+  return HTTP_action_start(FONA_HTTP_GET);
+}
 
-  DEBUG_PRINT("Status: "); DEBUG_PRINTLN(*status);
-  DEBUG_PRINT("Len: "); DEBUG_PRINTLN(*datalen);
+/**
+ * @brief Set up an empty HTTP_GET_cached() entry
+ *
+ * @param entry Pointer to the entry to set up
+ * @param body Pointer to a buffer to hold the cached body
+ * @param bodysize The size of the body buffer
+ */
+void Adafruit_FONA::HTTP_cacheInit(FONAHTTPCacheEntry* entry, uint8_t* body,
+                                   uint16_t bodysize) {
+  memset(entry, 0, sizeof(*entry));
+  entry->body = body;
+  entry->bodysize = bodysize;
+}
 
-  // HTTP response data
-  if (! HTTP_readall(datalen))
+/**
+ * @brief Copy a validator header into a cache entry field
+ *
+ * @param dst Pointer to the field
+ * @param dstlen The size of the field
+ * @param line Pointer to one response header line
+ * @param len The length of the line
+ * @param name The header to copy. The field is left alone if the line holds
+ * another header.
+ */
+static void copyValidator(char* dst, uint8_t dstlen, const char* line,
+                          uint16_t len, FONAFlashStringPtr name) {
+  FONAHTTPHeader header;
+  if (!Adafruit_FONA::HTTP_findHeader(line, len, name, &header))
+    return;
+
+  // a validator that doesn't fit is useless, drop it
+  uint8_t vlen = 0;
+  if (header.valuelen < dstlen) {
+    vlen = header.valuelen;
+    memcpy(dst, header.value, vlen);
+  }
+  dst[vlen] = 0;
+}
+
+/**
+ * @brief Read the response headers with AT+HTTPHEAD a line at a time into
+ * the reply buffer, keeping the validators of a cache entry. The block is
+ * never held whole, so a long one doesn't push them out.
+ *
+ * @param entry Pointer to the cache entry to fill
+ */
+void Adafruit_FONA::HTTP_readValidators(FONAHTTPCacheEntry* entry) {
+  entry->etag[0] = 0;
+  entry->lastmodified[0] = 0;
+
+  getReply(F("AT+HTTPHEAD"), 1000);
+
+  uint32_t total;
+  if (!parseReply(F("+HTTPHEAD:"), &total))
+    return;
+
+  uint8_t len = 0;
+  while (total > 0) {
+    uint8_t c;
+    if (readRaw(&c, 1, 1000) == 0)
+      break;
+    total--;
+
+    // longer lines are cut short; they can't hold a validator that fits
+    if ((c != '\n') && (len < sizeof(replybuffer) - 1))
+      replybuffer[len++] = c;
+    if ((c == '\n') || (total == 0)) {
+      copyValidator(entry->etag, sizeof(entry->etag), replybuffer, len,
+                    F("ETag"));
+      copyValidator(entry->lastmodified, sizeof(entry->lastmodified),
+                    replybuffer, len, F("Last-Modified"));
+      len = 0;
+    }
+  }
+  expectReply(ok_reply, 1000);
+}
+
+/**
+ * @brief Conditional HTTP GET backed by a response cache entry
+ *
+ * When the entry holds a body for this URL, the request carries
+ * If-None-Match / If-Modified-Since from it, and a 304 reply is answered
+ * from the cached body without reading anything from the module. A 200
+ * reply refreshes the entry's validators and body; changed is only set if
+ * the body digest differs, so servers without validators still avoid
+ * spurious updates. Finish with HTTP_GET_end().
+ *
+ * @param url Pointer to a buffer with the URL to request
+ * @param entry Pointer to the cache entry for this URL
+ * @param status Pointer to a uint16_t to hold the request status as an RFC2616
+ * HTTP response code: https://en.wikipedia.org/wiki/List_of_HTTP_status_codes
+ * @param changed Pointer to a bool set true when entry->body holds new
+ * content. A 200 body larger than the entry's buffer isn't cached; it is
+ * left on the module for HTTP_readStream() and changed is set true.
+ * @return true: success, false: failure
+ */
+bool Adafruit_FONA::HTTP_GET_cached(char* url, FONAHTTPCacheEntry* entry,
+                                    uint16_t* status, bool* changed) {
+  uint32_t urlhash = hashString(url);
+  bool cached = entry->cached && (entry->urlhash == urlhash);
+  uint8_t headers = httpheaders;
+  uint32_t datalen;
+
+  *changed = false;
+
+  if (cached && entry->etag[0])
+    HTTP_addHeader(F("If-None-Match"), entry->etag);
+  if (cached && entry->lastmodified[0])
+    HTTP_addHeader(F("If-Modified-Since"), entry->lastmodified);
+
+  bool ok = HTTP_GET_start(url, status, &datalen);
+  httpheaders = headers; // drop the conditional headers again
+  if (!ok)
     return false;
 
+  if ((*status == 304) && cached)
+    return true;
+  if (*status != 200)
+    return true;
+
+  // new content: forget the old entry until it is completely replaced
+  entry->cached = false;
+  entry->bodylen = 0;
+  if (datalen > entry->bodysize) {
+    *changed = true;
+    return true;
+  }
+
+  HTTP_readValidators(entry);
+
+  uint16_t got = 0;
+  while (got < datalen) {
+    uint16_t n = HTTP_read(got, entry->body + got, datalen - got);
+    if (n == 0)
+      return false;
+    got += n;
+  }
+
+  uint32_t bodyhash = hashBytes(entry->body, datalen);
+  *changed = !cached || (entry->bodyhash != bodyhash);
+  entry->urlhash = urlhash;
+  entry->bodyhash = bodyhash;
+  entry->bodylen = datalen;
+  entry->cached = true;
   return true;
 }
-*/
 
 /**
  * @brief End an HTTP GET
  *
  */
 void Adafruit_FONA::HTTP_GET_end(void) {
-  HTTP_term();
+  if (!httpsession)
+    HTTP_term();
 }
 
 /**
@@ -2254,7 +3518,7 @@ bool Adafruit_FONA::HTTP_POST_start(char* url, FONAFlashStringPtr contenttype,
   if (!HTTP_setup(url))
     return false;
 
-  if (!HTTP_para(F("CONTENT"), contenttype)) {
+  if (!HTTP_content(contenttype)) {
     return false;
   }
 
@@ -2280,12 +3544,174 @@ bool Adafruit_FONA::HTTP_POST_start(char* url, FONAFlashStringPtr contenttype,
 
   return true;
 }
+/**
+ * @brief Start an HTTP POST request whose body is pulled from a producer
+ * callback while the module is accepting data, so it never has to be held
+ * in RAM. The response body is left on the module for HTTP_read() or
+ * HTTP_readStream().
+ *
+ * @param url Pointer to a buffer with the URL to POST
+ * @param contenttype The message content type
+ * @param producer Function called to fill each chunk of the body
+ * @param context Pointer passed through to the producer
+ * @param postdatalen The total length of the POST data, at most 319488 bytes
+ * @param status Pointer to a uint16_t to hold the request status as an RFC2616
+ * HTTP response code: https://en.wikipedia.org/wiki/List_of_HTTP_status_codes
+ * @param datalen Pointer to a `uint32_t` to hold the length of the response
+ * body
+ * @return true: success, false: failure or the producer ran out early
+ */
+bool Adafruit_FONA::HTTP_POST_start(char* url, FONAFlashStringPtr contenttype,
+                                    FONAHTTPWriteCallback producer,
+                                    void* context, uint32_t postdatalen,
+                                    uint16_t* status, uint32_t* datalen) {
+  if (!HTTP_setup(url))
+    return false;
+
+  if (!HTTP_content(contenttype)) {
+    return false;
+  }
+
+  // HTTP POST data, allowing about 1 ms per byte over the serial link
+  uint32_t maxTime = 10000 + postdatalen;
+  if (maxTime > 120000)
+    maxTime = 120000;
+  if (!HTTP_data(postdatalen, maxTime))
+    return false;
+
+  uint8_t chunk[32];
+  uint32_t sent = 0;
+  while (sent < postdatalen) {
+    uint16_t want = sizeof(chunk);
+    if (postdatalen - sent < want)
+      want = postdatalen - sent;
+
+    uint16_t got = producer(chunk, want, sent, context);
+    if (got == 0)
+      break;
+
+    mySerial->write(chunk, got);
+    sent += got;
+  }
+
+  // if the producer ran dry the module only answers once maxTime expires
+  if (sent != postdatalen) {
+    expectReply(ok_reply, (maxTime > 65535) ? 65535 : maxTime);
+    return false;
+  }
+  if (!expectReply(ok_reply))
+    return false;
+
+  // HTTP POST
+  if (!HTTP_action(FONA_HTTP_POST, status, datalen))
+    return false;
+
+  DEBUG_PRINT(F("Status: "));
+  DEBUG_PRINTLN(*status);
+  DEBUG_PRINT(F("Len: "));
+  DEBUG_PRINTLN(*datalen);
+
+  return true;
+}
+
+/**
+ * @brief Producer that reads the POST body from a Stream
+ *
+ * @param data Buffer to fill
+ * @param maxlen Maximum bytes to read
+ * @param offset Offset within the body (unused, streams are sequential)
+ * @param context The FONAStreamType to read from
+ * @return uint16_t The number of bytes read
+ */
+static uint16_t readPostStream(uint8_t* data, uint16_t maxlen, uint32_t offset,
+                               void* context) {
+  (void)offset;
+  return ((FONAStreamType*)context)->readBytes(data, maxlen);
+}
+
+/**
+ * @brief Start an HTTP POST request whose body is read from a Stream, such as
+ * a file on an SD card. The response body is left on the module for
+ * HTTP_read() or HTTP_readStream().
+ *
+ * @param url Pointer to a buffer with the URL to POST
+ * @param contenttype The message content type
+ * @param source The stream to read postdatalen bytes from
+ * @param postdatalen The total length of the POST data, at most 319488 bytes
+ * @param status Pointer to a uint16_t to hold the request status as an RFC2616
+ * HTTP response code: https://en.wikipedia.org/wiki/List_of_HTTP_status_codes
+ * @param datalen Pointer to a `uint32_t` to hold the length of the response
+ * body
+ * @return true: success, false: failure or the stream ran out early
+ */
+bool Adafruit_FONA::HTTP_POST_start(char* url, FONAFlashStringPtr contenttype,
+                                    FONAStreamType& source,
+                                    uint32_t postdatalen, uint16_t* status,
+                                    uint32_t* datalen) {
+  return HTTP_POST_start(url, contenttype, readPostStream, &source,
+                         postdatalen, status, datalen);
+}
+
+/**
+ * @brief Start an HTTP POST request whose body is written by a callback
+ * straight to the module, e.g. with a FONACBOREncoder. The callback runs once
+ * into a FONACountingPrint to size the body, then again during AT+HTTPDATA.
+ * The response body is left on the module for HTTP_read() or
+ * HTTP_readStream().
+ *
+ * @param url Pointer to a buffer with the URL to POST
+ * @param contenttype The message content type
+ * @param writer Function that writes the body
+ * @param context Pointer passed through to the writer
+ * @param status Pointer to a uint16_t to hold the request status as an RFC2616
+ * HTTP response code: https://en.wikipedia.org/wiki/List_of_HTTP_status_codes
+ * @param datalen Pointer to a `uint32_t` to hold the length of the response
+ * body
+ * @return true: success, false: failure
+ */
+bool Adafruit_FONA::HTTP_POST_start(char* url, FONAFlashStringPtr contenttype,
+                                    FONAHTTPBodyCallback writer,
+                                    void* context, uint16_t* status,
+                                    uint32_t* datalen) {
+  FONACountingPrint counter;
+  writer(counter, context);
+
+  if (!HTTP_setup(url))
+    return false;
+
+  if (!HTTP_content(contenttype)) {
+    return false;
+  }
+
+  // HTTP POST data, allowing about 1 ms per byte over the serial link
+  uint32_t maxTime = 10000 + counter.count;
+  if (maxTime > 120000)
+    maxTime = 120000;
+  if (!HTTP_data(counter.count, maxTime))
+    return false;
+  writer(*mySerial, context);
+  if (!expectReply(ok_reply))
+    return false;
+
+  // HTTP POST
+  if (!HTTP_action(FONA_HTTP_POST, status, datalen))
+    return false;
+
+  DEBUG_PRINT(F("Status: "));
+  DEBUG_PRINTLN(*status);
+  DEBUG_PRINT(F("Len: "));
+  DEBUG_PRINTLN(*datalen);
+
+  return true;
+}
+
 /**
  * @brief End an HTTP POST request
  *
  */
 void Adafruit_FONA::HTTP_POST_end(void) {
-  HTTP_term();
+  if (!httpsession)
+    HTTP_term();
 }
 
 /**
@@ -2305,6 +3731,23 @@ void Adafruit_FONA::setHTTPSRedirect(bool onoff) {
   httpsredirect = onoff;
 }
 
+/**
+ * @brief Keep the HTTP service initialized between requests
+ *
+ * While a session is on, HTTP_GET_end() and HTTP_POST_end() leave HTTPINIT
+ * alive and each request only resends the HTTPPARA values that changed, so a
+ * repeated request to the same URL costs just the data and action commands.
+ * Call HTTP_term() (or turn the session off) to reset the module's HTTP
+ * state, e.g. after calling HTTP_para() or HTTP_ssl() directly.
+ *
+ * @param onoff true: keep the session, false: end it and terminate HTTP
+ */
+void Adafruit_FONA::setHTTPSession(bool onoff) {
+  if (!onoff && httpsession && (httpcache & FONA_HTTP_CACHE_INIT))
+    HTTP_term();
+  httpsession = onoff;
+}
+
 /********* HTTP HELPERS ****************************************/
 
 /**
@@ -2314,28 +3757,111 @@ void Adafruit_FONA::setHTTPSRedirect(bool onoff) {
  * @return true: success, false: failure
  */
 bool Adafruit_FONA::HTTP_setup(char* url) {
-  // Handle any pending
-  HTTP_term();
-
-  // Initialize and set parameters
-  if (!HTTP_init())
-    return false;
-  if (!HTTP_para(F("CID"), 1))
-    return false;
-  if (!HTTP_para(F("UA"), useragent))
-    return false;
-  if (!HTTP_para(F("URL"), url))
+  // the SIM5320 has no AT+HTTP* commands, whichever object is used
+  if ((_type == FONA3G_A) || (_type == FONA3G_E))
     return false;
 
+  if (!httpsession || !(httpcache & FONA_HTTP_CACHE_INIT)) {
+    // Handle any pending
+    HTTP_term();
+
+    // Initialize
+    if (!HTTP_init())
+      return false;
+  }
+
+  // Set the parameters the module doesn't already have. The cache stays
+  // cleared until they all succeed, so a failure forces a fresh HTTPINIT.
+  uint8_t cache = httpcache;
+  httpcache = 0;
+
+  if (!(cache & FONA_HTTP_CACHE_CID)) {
+    if (!HTTP_para(F("CID"), 1))
+      return false;
+    cache |= FONA_HTTP_CACHE_CID;
+  }
+
+  if (!(cache & FONA_HTTP_CACHE_UA) || (httplastua != useragent)) {
+    if (!HTTP_para(F("UA"), useragent))
+      return false;
+    httplastua = useragent;
+    cache |= FONA_HTTP_CACHE_UA;
+  }
+
+  uint32_t urlhash = hashString(url);
+  if (!(cache & FONA_HTTP_CACHE_URL) || (httpurlhash != urlhash)) {
+    if (!HTTP_para(F("URL"), url))
+      return false;
+    httpurlhash = urlhash;
+    cache |= FONA_HTTP_CACHE_URL;
+  }
+
   // HTTPS redirect
-  if (httpsredirect) {
+  if (httpsredirect && !(cache & FONA_HTTP_CACHE_REDIR)) {
     if (!HTTP_para(F("REDIR"), 1))
       return false;
 
     if (!HTTP_ssl(true))
       return false;
+    cache |= FONA_HTTP_CACHE_REDIR;
+  } else if (!httpsredirect && (cache & FONA_HTTP_CACHE_REDIR)) {
+    if (!HTTP_para(F("REDIR"), (int32_t)0))
+      return false;
+
+    if (!HTTP_ssl(false))
+      return false;
+    cache &= ~FONA_HTTP_CACHE_REDIR;
+  }
+
+  // Custom request headers, sent as one USERDATA parameter. Names are
+  // flash strings, so their address identifies them.
+  uint32_t userdatahash = 2166136261UL;
+  for (uint8_t i = 0; i < httpheaders; i++) {
+    userdatahash ^= (uintptr_t)httpheadername[i];
+    userdatahash = hashString(httpheadervalue[i], userdatahash);
+  }
+  if ((httpheaders && (!(cache & FONA_HTTP_CACHE_USERDATA) ||
+                       (httpuserdatahash != userdatahash))) ||
+      (!httpheaders && (cache & FONA_HTTP_CACHE_USERDATA))) {
+    HTTP_para_start(F("USERDATA"), true);
+    for (uint8_t i = 0; i < httpheaders; i++) {
+      if (i)
+        mySerial->print(F("\\r\\n")); // the module expands these escapes
+      mySerial->print(httpheadername[i]);
+      mySerial->print(F(": "));
+      mySerial->print(httpheadervalue[i]);
+    }
+    if (!HTTP_para_end(true))
+      return false;
+
+    httpuserdatahash = userdatahash;
+    if (httpheaders)
+      cache |= FONA_HTTP_CACHE_USERDATA;
+    else
+      cache &= ~FONA_HTTP_CACHE_USERDATA;
   }
 
+  httpcache = cache;
+  return true;
+}
+
+/**
+ * @brief Set the HTTP content type, unless the module already has it
+ *
+ * @param contenttype The message content type
+ * @return true: success, false: failure
+ */
+bool Adafruit_FONA::HTTP_content(FONAFlashStringPtr contenttype) {
+  if ((httpcache & FONA_HTTP_CACHE_CONTENT) &&
+      (httplastcontent == contenttype))
+    return true;
+
+  if (!HTTP_para(F("CONTENT"), contenttype)) {
+    httpcache = 0;
+    return false;
+  }
+  httplastcontent = contenttype;
+  httpcache |= FONA_HTTP_CACHE_CONTENT;
   return true;
 }
 
@@ -2404,32 +3930,108 @@ inline void Adafruit_FONA::flush() {
  *
  */
 void Adafruit_FONA::flushInput() {
+  // Keep the start of each discarded line so URCs aren't lost.
+  char line[32];
+  uint8_t lineidx = 0;
   uint16_t timeoutloop = 0;
   while (timeoutloop++ < 40) {
     while (available()) {
-      read();
+      char c = read();
+      if (c == '\n') {
+        line[lineidx] = 0;
+        handleURC(line);
+        lineidx = 0;
+      } else if ((c != '\r') && (lineidx < sizeof(line) - 1)) {
+        line[lineidx++] = c;
+      }
       timeoutloop = 0; // If char was received reset the timer
     }
     delay(1);
   }
 }
+
+/**
+ * @brief Remember any unsolicited result code in a line read from the module
+ *
+ * @param line The line to check
+ */
+void Adafruit_FONA::handleURC(const char* line) {
+  // "CLOSED" in single connection mode, "<n>, CLOSED" in multi connection mode
+  if ((prog_char_strcmp(line, (prog_char*)F("CLOSED")) == 0) ||
+      (prog_char_strstr(line, (prog_char*)F(", CLOSED")) != 0)) {
+    urcflags |= FONA_URC_TCP_CLOSED;
+  } else if ((prog_char_strstr(line, (prog_char*)F("+PDP: DEACT")) == line) ||
+             ((prog_char_strstr(line, (prog_char*)F("+SAPBR")) == line) &&
+              (prog_char_strstr(line, (prog_char*)F("DEACT")) != 0))) {
+    urcflags |= FONA_URC_PDP_DEACT;
+  } else if ((httpactionstate == FONA_HTTP_ACTION_PENDING) &&
+             (prog_char_strstr(line, (prog_char*)F("+HTTPACTION:")) == line)) {
+    // +HTTPACTION: <method>,<status>,<datalen>
+    const char* p = strchr(line, ',');
+    if (!p)
+      return;
+    httpactionstatus = atoi(p + 1);
+    p = strchr(p + 1, ',');
+    httpactionlen = p ? strtoul(p + 1, NULL, 10) : 0;
+    httpactionstate = FONA_HTTP_ACTION_DONE;
+    urcflags |= FONA_URC_HTTPACTION;
+  } else if (prog_char_strstr(line, (prog_char*)F("+CMTI:")) == line) {
+    // +CMTI: <mem>,<index>
+    const char* p = strchr(line, ',');
+    if (p && (smsqueuelen < FONA_SMS_QUEUE)) {
+      smsqueue[(smsqueuehead + smsqueuelen) % FONA_SMS_QUEUE] = atoi(p + 1);
+      smsqueuelen++;
+    }
+    urcflags |= FONA_URC_NEW_SMS;
+  }
+}
+
 /**
  * @brief Read directly into the reply buffer
  *
- * @param read_length The number of bytes to return
+ * @param read_length The number of bytes to return
+ * @return uint16_t The number of bytes read
+ */
+uint16_t Adafruit_FONA::readRaw(uint16_t read_length) {
+  uint16_t idx = 0;
+
+  while (read_length && (idx < sizeof(replybuffer) - 1)) {
+    if (mySerial->available()) {
+      replybuffer[idx] = mySerial->read();
+      idx++;
+      read_length--;
+    }
+  }
+  replybuffer[idx] = 0;
+
+  return idx;
+}
+
+/**
+ * @brief Read directly into a caller supplied buffer
+ *
+ * @param buff Pointer to a buffer to hold the data, or 0 to discard it
+ * @param read_length The number of bytes to read
+ * @param timeout Give up after this many milliseconds without data
  * @return uint16_t The number of bytes read
  */
-uint16_t Adafruit_FONA::readRaw(uint16_t read_length) {
+uint16_t Adafruit_FONA::readRaw(uint8_t* buff, uint16_t read_length,
+                                uint16_t timeout) {
   uint16_t idx = 0;
+  uint16_t idle = 0;
 
-  while (read_length && (idx < sizeof(replybuffer) - 1)) {
+  while ((idx < read_length) && (idle < timeout)) {
     if (mySerial->available()) {
-      replybuffer[idx] = mySerial->read();
+      uint8_t c = mySerial->read();
+      if (buff)
+        buff[idx] = c;
       idx++;
-      read_length--;
+      idle = 0;
+    } else {
+      delay(1);
+      idle++;
     }
   }
-  replybuffer[idx] = 0;
 
   return idx;
 }
@@ -2805,6 +4407,34 @@ bool Adafruit_FONA::parseReply(FONAFlashStringPtr toreply, uint16_t* v,
   return true;
 }
 
+/**
+ * @brief Parse a 32-bit value in the response fields using a designated
+ * separator
+ *
+ * @param toreply Pointer to a buffer with reply with the field being parsed
+ * @param v Pointer to a uint32_t to fill with the value from the parsed field
+ * @param divider The divider character
+ * @param index The index of the parsed field to retrieve
+ * @return true: success, false: failure
+ */
+bool Adafruit_FONA::parseReply(FONAFlashStringPtr toreply, uint32_t* v,
+                               char divider, uint8_t index) {
+  char* p = prog_char_strstr(replybuffer, (prog_char*)toreply);
+  if (p == 0)
+    return false;
+  p += prog_char_strlen((prog_char*)toreply);
+  for (uint8_t i = 0; i < index; i++) {
+    // increment dividers
+    p = strchr(p, divider);
+    if (!p)
+      return false;
+    p++;
+  }
+  *v = strtoul(p, NULL, 10);
+
+  return true;
+}
+
 /**
 
  * @brief Parse a string in the response fields using a designated separator
@@ -2971,3 +4601,557 @@ bool Adafruit_FONA_3G::parseReply(FONAFlashStringPtr toreply, float* f,
 
   return true;
 }
+
+/********* 3G HTTP *********************************************/
+
+/**
+ * @brief Split a URL into scheme, host, port and path without copying it
+ *
+ * @param url The URL, with or without an http:// or https:// prefix
+ * @param https Set to true for https URLs
+ * @param host Set to the start of the host name
+ * @param hostlen Set to the length of the host name
+ * @param port Set to the port, 80 or 443 unless the URL gives one
+ * @param path Set to the path and query, "/" if the URL has none
+ * @return true: success, false: no host or a bad port
+ */
+static bool splitURL(const char* url, bool* https, const char** host,
+                     uint8_t* hostlen, uint16_t* port, const char** path) {
+  *https = false;
+  *port = 80;
+  if (prog_char_strncasecmp(url, (prog_char*)F("http://"), 7) == 0) {
+    url += 7;
+  } else if (prog_char_strncasecmp(url, (prog_char*)F("https://"), 8) == 0) {
+    url += 8;
+    *https = true;
+    *port = 443;
+  }
+
+  *host = url;
+  while (*url && (*url != '/') && (*url != ':'))
+    url++;
+  if ((url - *host) > 255)
+    return false;
+  *hostlen = url - *host;
+
+  if (*url == ':') {
+    *port = atoi(url + 1);
+    while (*url && (*url != '/'))
+      url++;
+  }
+
+  *path = *url ? url : "/";
+  return (*hostlen > 0) && (*port > 0);
+}
+
+/**
+ * @brief GET a URL with AT+CHTTPACT, or AT+CHTTPS* for https URLs, handing
+ * the response body to a callback as it arrives
+ *
+ * @param url Pointer to a buffer with the URL to GET
+ * @param status Pointer to a uint16_t to hold the request status as an RFC2616
+ * HTTP response code: https://en.wikipedia.org/wiki/List_of_HTTP_status_codes
+ * @param callback Function called with each chunk of the body, may be 0
+ * @param context Pointer passed through to the callback
+ * @return true: success, false: failure or the callback stopped the transfer
+ */
+bool Adafruit_FONA_3G::HTTP_GET(char* url, uint16_t* status,
+                                FONAHTTPReadCallback callback,
+                                void* context) {
+  FONAHTTPResponseParser parser;
+  parser.begin(callback, context);
+
+  bool ok = HTTP_request(F("GET"), url, 0, 0, 0, 0, &parser);
+  *status = parser.status();
+
+  DEBUG_PRINT(F("Status: "));
+  DEBUG_PRINTLN(*status);
+
+  return ok;
+}
+
+/**
+ * @brief POST to a URL with AT+CHTTPACT, or AT+CHTTPS* for https URLs. The
+ * body is pulled from a producer callback and the response body handed to a
+ * callback, so neither has to be held in RAM.
+ *
+ * @param url Pointer to a buffer with the URL to POST
+ * @param contenttype The message content type
+ * @param producer Function called to fill each chunk of the body
+ * @param pcontext Pointer passed through to the producer
+ * @param postdatalen The total length of the POST data
+ * @param status Pointer to a uint16_t to hold the request status as an RFC2616
+ * HTTP response code: https://en.wikipedia.org/wiki/List_of_HTTP_status_codes
+ * @param callback Function called with each chunk of the body, may be 0
+ * @param context Pointer passed through to the callback
+ * @return true: success, false: failure or a callback stopped the transfer
+ */
+bool Adafruit_FONA_3G::HTTP_POST(char* url, FONAFlashStringPtr contenttype,
+                                 FONAHTTPWriteCallback producer,
+                                 void* pcontext, uint32_t postdatalen,
+                                 uint16_t* status,
+                                 FONAHTTPReadCallback callback,
+                                 void* context) {
+  FONAHTTPResponseParser parser;
+  parser.begin(callback, context);
+
+  bool ok = HTTP_request(F("POST"), url, contenttype, producer, pcontext,
+                         postdatalen, &parser);
+  *status = parser.status();
+
+  DEBUG_PRINT(F("Status: "));
+  DEBUG_PRINTLN(*status);
+
+  return ok;
+}
+
+/**
+ * @brief AT+HTTPACTION is not available on the SIM5320, use HTTP_GET() or
+ * HTTP_POST()
+ *
+ * @return false
+ */
+bool Adafruit_FONA_3G::HTTP_action(uint8_t, uint16_t*, uint16_t*, int32_t) {
+  return false;
+}
+
+/**
+ * @brief AT+HTTPACTION is not available on the SIM5320, use HTTP_GET() or
+ * HTTP_POST()
+ *
+ * @return false
+ */
+bool Adafruit_FONA_3G::HTTP_action(uint8_t, uint16_t*, uint32_t*, int32_t) {
+  return false;
+}
+
+/**
+ * @brief AT+HTTPACTION is not available on the SIM5320, use HTTP_GET() or
+ * HTTP_POST()
+ *
+ * @return false
+ */
+bool Adafruit_FONA_3G::HTTP_action_start(uint8_t, uint32_t) {
+  return false;
+}
+
+/**
+ * @brief The SIM800 GET flow is not available on the SIM5320, use HTTP_GET()
+ *
+ * @return false
+ */
+bool Adafruit_FONA_3G::HTTP_GET_start(char*, uint16_t*, uint16_t*) {
+  return false;
+}
+
+/**
+ * @brief The SIM800 GET flow is not available on the SIM5320, use HTTP_GET()
+ *
+ * @return false
+ */
+bool Adafruit_FONA_3G::HTTP_GET_start(char*, uint16_t*, uint32_t*) {
+  return false;
+}
+
+/**
+ * @brief The SIM800 GET flow is not available on the SIM5320, use HTTP_GET()
+ *
+ * @return false
+ */
+bool Adafruit_FONA_3G::HTTP_GET_async(char*) {
+  return false;
+}
+
+/**
+ * @brief The SIM800 GET flow is not available on the SIM5320, use HTTP_GET()
+ *
+ * @return false
+ */
+bool Adafruit_FONA_3G::HTTP_GET_cached(char*, FONAHTTPCacheEntry*, uint16_t*,
+                                       bool*) {
+  return false;
+}
+
+/**
+ * @brief The SIM800 POST flow is not available on the SIM5320, use
+ * HTTP_POST()
+ *
+ * @return false
+ */
+bool Adafruit_FONA_3G::HTTP_POST_start(char*, FONAFlashStringPtr,
+                                       const uint8_t*, uint16_t, uint16_t*,
+                                       uint16_t*) {
+  return false;
+}
+
+/**
+ * @brief The SIM800 POST flow is not available on the SIM5320, use
+ * HTTP_POST()
+ *
+ * @return false
+ */
+bool Adafruit_FONA_3G::HTTP_POST_start(char*, FONAFlashStringPtr,
+                                       FONAHTTPWriteCallback, void*, uint32_t,
+                                       uint16_t*, uint32_t*) {
+  return false;
+}
+
+/**
+ * @brief The SIM800 POST flow is not available on the SIM5320, use
+ * HTTP_POST()
+ *
+ * @return false
+ */
+bool Adafruit_FONA_3G::HTTP_POST_start(char*, FONAFlashStringPtr,
+                                       FONAStreamType&, uint32_t, uint16_t*,
+                                       uint32_t*) {
+  return false;
+}
+
+/**
+ * @brief The SIM800 POST flow is not available on the SIM5320, use
+ * HTTP_POST()
+ *
+ * @return false
+ */
+bool Adafruit_FONA_3G::HTTP_POST_start(char*, FONAFlashStringPtr,
+                                       FONAHTTPBodyCallback, void*, uint16_t*,
+                                       uint32_t*) {
+  return false;
+}
+
+/**
+ * @brief Send a request and parse the response. The request is measured
+ * with a FONACountingPrint first, as both AT+CHTTPACT and AT+CHTTPSSEND need
+ * its length before the data.
+ *
+ * @param method The request method
+ * @param url Pointer to a buffer with the URL
+ * @param contenttype The body content type, 0 for no body
+ * @param producer Function called to fill each chunk of the body
+ * @param pcontext Pointer passed through to the producer
+ * @param postdatalen The length of the body
+ * @param parser The parser to feed the response to
+ * @return true: success, false: failure
+ */
+bool Adafruit_FONA_3G::HTTP_request(FONAFlashStringPtr method, char* url,
+                                    FONAFlashStringPtr contenttype,
+                                    FONAHTTPWriteCallback producer,
+                                    void* pcontext, uint32_t postdatalen,
+                                    FONAHTTPResponseParser* parser) {
+  bool https;
+  const char* host;
+  uint8_t hostlen;
+  uint16_t port;
+  const char* path;
+
+  if (!splitURL(url, &https, &host, &hostlen, &port, &path))
+    return false;
+
+  FONACountingPrint head;
+  HTTP_writeHead(head, method, host, hostlen, port, path, contenttype,
+                 postdatalen);
+
+  if (https) {
+    if (!HTTPS_open(host, hostlen, port))
+      return false;
+
+    bool ok = HTTPS_send(head.count);
+    if (ok) {
+      HTTP_writeHead(*mySerial, method, host, hostlen, port, path,
+                     contenttype, postdatalen);
+      ok = expectReply(ok_reply, 10000);
+    }
+    for (uint32_t sent = 0; ok && (sent < postdatalen);) {
+      uint16_t len = FONA_HTTPS_SEND_MAX;
+      if (postdatalen - sent < len)
+        len = postdatalen - sent;
+      ok = HTTPS_send(len) && HTTP_writeBody(producer, pcontext, sent, len) &&
+           expectReply(ok_reply, 10000);
+      sent += len;
+    }
+    if (ok)
+      ok = HTTPS_receive(parser, 60000);
+
+    HTTPS_close();
+    return ok;
+  }
+
+  flushInput();
+
+  DEBUG_PRINT(F("\t---> "));
+  DEBUG_PRINTLN(F("AT+CHTTPACT"));
+
+  mySerial->print(F("AT+CHTTPACT=\""));
+  mySerial->write((const uint8_t*)host, hostlen);
+  mySerial->print(F("\","));
+  mySerial->print(port);
+  mySerial->print(',');
+  mySerial->println(head.count + postdatalen);
+
+  // the module opens the connection before asking for the request
+  readline(30000);
+  DEBUG_PRINT(F("\t<--- "));
+  DEBUG_PRINTLN(replybuffer);
+  if (prog_char_strcmp(replybuffer, (prog_char*)F("+CHTTPACT: REQUEST")) != 0)
+    return false;
+
+  HTTP_writeHead(*mySerial, method, host, hostlen, port, path, contenttype,
+                 postdatalen);
+  if (!HTTP_writeBody(producer, pcontext, 0, postdatalen))
+    return false;
+
+  return HTTP_receive(parser);
+}
+
+/**
+ * @brief Write the request line and headers, including any added with
+ * HTTP_addHeader()
+ *
+ * @param out Where to write the request head
+ * @param method The request method
+ * @param host The host name, not terminated
+ * @param hostlen The length of the host name
+ * @param port The server port, added to the Host header if not the default
+ * @param path The path and query
+ * @param contenttype The body content type, 0 for no body
+ * @param postdatalen The length of the body
+ */
+void Adafruit_FONA_3G::HTTP_writeHead(Print& out, FONAFlashStringPtr method,
+                                      const char* host, uint8_t hostlen,
+                                      uint16_t port, const char* path,
+                                      FONAFlashStringPtr contenttype,
+                                      uint32_t postdatalen) {
+  out.print(method);
+  out.print(' ');
+  out.print(path);
+  out.print(F(" HTTP/1.1\r\nHost: "));
+  out.write((const uint8_t*)host, hostlen);
+  if ((port != 80) && (port != 443)) {
+    out.print(':');
+    out.print(port);
+  }
+  out.print(F("\r\nUser-Agent: "));
+  out.print(useragent);
+  out.print(F("\r\n"));
+
+  for (uint8_t i = 0; i < httpheaders; i++) {
+    out.print(httpheadername[i]);
+    out.print(F(": "));
+    out.print(httpheadervalue[i]);
+    out.print(F("\r\n"));
+  }
+
+  if (contenttype) {
+    out.print(F("Content-Type: "));
+    out.print(contenttype);
+    out.print(F("\r\nContent-Length: "));
+    out.print(postdatalen);
+    out.print(F("\r\n"));
+  }
+
+  // the module only runs one request per connection
+  out.print(F("Connection: close\r\n\r\n"));
+}
+
+/**
+ * @brief Write part of the body from a producer callback
+ *
+ * @param producer Function called to fill each chunk of the body
+ * @param context Pointer passed through to the producer
+ * @param offset Offset of the first byte to write within the body
+ * @param len The number of bytes to write
+ * @return true: success, false: the producer ran out early
+ */
+bool Adafruit_FONA_3G::HTTP_writeBody(FONAHTTPWriteCallback producer,
+                                      void* context, uint32_t offset,
+                                      uint32_t len) {
+  uint8_t chunk[32];
+  uint32_t end = offset + len;
+
+  while (offset < end) {
+    uint16_t want = sizeof(chunk);
+    if (end - offset < want)
+      want = end - offset;
+
+    uint16_t got = producer(chunk, want, offset, context);
+    if (got == 0)
+      return false;
+
+    mySerial->write(chunk, got);
+    offset += got;
+  }
+
+  return true;
+}
+
+/**
+ * @brief Read a block of response data from the module into the parser.
+ * Whatever the parser doesn't take, after the end of the response or a
+ * stopped callback, is dropped.
+ *
+ * @param len The number of bytes the module announced
+ * @param parser The parser to feed
+ * @return true: success, false: the module sent less than announced
+ */
+bool Adafruit_FONA_3G::HTTP_feed(uint32_t len,
+                                 FONAHTTPResponseParser* parser) {
+  uint8_t buff[32];
+
+  while (len) {
+    uint16_t want = sizeof(buff);
+    if (len < want)
+      want = len;
+
+    uint16_t got = readRaw(buff, want, 1000);
+    if (got == 0)
+      return false;
+
+    parser->feed(buff, got);
+    len -= got;
+  }
+
+  return true;
+}
+
+/**
+ * @brief Read the +CHTTPACT: DATA blocks of a response up to the final
+ * +CHTTPACT result code
+ *
+ * @param parser The parser to feed the response to
+ * @return true: a complete response arrived, false: failure
+ */
+bool Adafruit_FONA_3G::HTTP_receive(FONAHTTPResponseParser* parser) {
+  while (true) {
+    if (!readline(60000))
+      return false;
+
+    DEBUG_PRINT(F("\t<--- "));
+    DEBUG_PRINTLN(replybuffer);
+
+    uint32_t len;
+    if (Adafruit_FONA::parseReply(F("+CHTTPACT: DATA,"), &len)) {
+      if (!HTTP_feed(len, parser))
+        return false;
+    } else if (Adafruit_FONA::parseReply(F("+CHTTPACT: "), &len)) {
+      // 0 once the server has closed the connection
+      parser->finish();
+      return (len == 0) && parser->done();
+    } else if (prog_char_strcmp(replybuffer, (prog_char*)F("ERROR")) == 0) {
+      return false;
+    }
+  }
+}
+
+/**
+ * @brief Start the HTTPS stack and open a connection
+ *
+ * @param host The host name, not terminated
+ * @param hostlen The length of the host name
+ * @param port The server port
+ * @return true: success, false: failure
+ */
+bool Adafruit_FONA_3G::HTTPS_open(const char* host, uint8_t hostlen,
+                                  uint16_t port) {
+  // ERROR here just means the stack is still running from an earlier request
+  sendCheckReply(F("AT+CHTTPSSTART"), ok_reply, 10000);
+
+  flushInput();
+
+  DEBUG_PRINT(F("\t---> "));
+  DEBUG_PRINTLN(F("AT+CHTTPSOPSE"));
+
+  mySerial->print(F("AT+CHTTPSOPSE=\""));
+  mySerial->write((const uint8_t*)host, hostlen);
+  mySerial->print(F("\","));
+  mySerial->println(port);
+
+  return expectReply(ok_reply, 30000);
+}
+
+/**
+ * @brief Start an AT+CHTTPSSEND and wait for the prompt
+ *
+ * @param len The number of bytes to send, at most 4096
+ * @return true: the module is waiting for the data, false: failure
+ */
+bool Adafruit_FONA_3G::HTTPS_send(uint16_t len) {
+  flushInput();
+
+  DEBUG_PRINT(F("\t---> "));
+  DEBUG_PRINT(F("AT+CHTTPSSEND="));
+  DEBUG_PRINTLN(len);
+
+  mySerial->print(F("AT+CHTTPSSEND="));
+  mySerial->println(len);
+
+  // the prompt has no line end, so this returns after the timeout
+  readline(FONA_DEFAULT_TIMEOUT_MS);
+  DEBUG_PRINT(F("\t<--- "));
+  DEBUG_PRINTLN(replybuffer);
+
+  return replybuffer[0] == '>';
+}
+
+/**
+ * @brief Pull the response with AT+CHTTPSRECV until it is complete or the
+ * server closes the connection
+ *
+ * @param parser The parser to feed the response to
+ * @param timeout Give up after this many milliseconds
+ * @return true: a complete response arrived, false: failure
+ */
+bool Adafruit_FONA_3G::HTTPS_receive(FONAHTTPResponseParser* parser,
+                                     uint32_t timeout) {
+  uint32_t start = millis();
+  bool closed = false;
+
+  while (!parser->done() && !parser->failed() && !closed) {
+    if (millis() - start > timeout)
+      return false;
+
+    flushInput();
+    mySerial->print(F("AT+CHTTPSRECV="));
+    mySerial->println(FONA_HTTPS_RECV_MAX);
+
+    bool got = false;
+    while (true) {
+      if (!readline(5000))
+        return false;
+
+      uint32_t len;
+      if (prog_char_strstr(replybuffer, (prog_char*)F("PEER CLOSED"))) {
+        closed = true;
+      } else if (Adafruit_FONA::parseReply(F("+CHTTPSRECV: DATA,"), &len)) {
+        if (!HTTP_feed(len, parser))
+          return false;
+        got = true;
+      } else if (Adafruit_FONA::parseReply(F("+CHTTPSRECV: "), &len)) {
+        if (len != 0)
+          closed = true;
+        break;
+      } else if (prog_char_strcmp(replybuffer, (prog_char*)F("ERROR")) ==
+                 0) {
+        closed = true;
+        break;
+      }
+    }
+
+    // nothing buffered yet, give the server a moment
+    if (!got && !closed)
+      delay(100);
+  }
+
+  if (closed)
+    parser->finish();
+  return parser->done();
+}
+
+/**
+ * @brief Close the HTTPS connection and stop the stack
+ *
+ */
+void Adafruit_FONA_3G::HTTPS_close(void) {
+  sendCheckReply(F("AT+CHTTPSCLSE"), ok_reply, 5000);
+  sendCheckReply(F("AT+CHTTPSSTOP"), ok_reply, 5000);
+}
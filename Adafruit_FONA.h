@@ -23,6 +23,30 @@
 #define FONA_PREF_SMS_STORAGE "\"SM\""
 // #define FONA_PREF_SMS_STORAGE "\"ME\""
 
+// SMS status, as used by AT+CMGL and in PDU mode
+#define FONA_SMS_REC_UNREAD 0
+#define FONA_SMS_REC_READ 1
+#define FONA_SMS_STO_UNSENT 2
+#define FONA_SMS_STO_SENT 3
+#define FONA_SMS_ALL 4
+
+// AT+CMGD delete flags for deleteAllSMS(): read messages, read and sent,
+// read, sent and unsent, or every message including unread ones
+#define FONA_SMS_DEL_READ 1
+#define FONA_SMS_DEL_READ_SENT 2
+#define FONA_SMS_DEL_ALL_STORED 3
+#define FONA_SMS_DEL_ALL 4
+
+// Most parts readSMSConcat() reassembles
+#ifndef FONA_SMS_MAX_PARTS
+#define FONA_SMS_MAX_PARTS 8
+#endif
+
+// Space for the address in a FONASMSHeader
+#ifndef FONA_SMS_ADDR_LEN
+#define FONA_SMS_ADDR_LEN 24
+#endif
+
 #define FONA_HEADSETAUDIO 0
 #define FONA_EXTAUDIO 1
 
@@ -46,12 +70,136 @@
 #define FONA_HTTP_POST 1
 #define FONA_HTTP_HEAD 2
 
+// Request headers that can be queued with HTTP_addHeader()
+#ifndef FONA_HTTP_MAX_HEADERS
+#define FONA_HTTP_MAX_HEADERS 4
+#endif
+
+// Space for the ETag and Last-Modified validators in a FONAHTTPCacheEntry
+#ifndef FONA_HTTP_ETAG_LEN
+#define FONA_HTTP_ETAG_LEN 48
+#endif
+#define FONA_HTTP_DATE_LEN 32
+
 #define FONA_CALL_READY 0
 #define FONA_CALL_FAILED 1
 #define FONA_CALL_UNKNOWN 2
 #define FONA_CALL_RINGING 3
 #define FONA_CALL_INPROGRESS 4
 
+// Unsolicited result codes remembered by pollURC(), as a bitmask.
+#define FONA_URC_TCP_CLOSED 0x01
+#define FONA_URC_PDP_DEACT 0x02
+#define FONA_URC_HTTPACTION 0x04
+#define FONA_URC_NEW_SMS 0x08
+
+// New message indices queued from +CMTI until getNewSMS() takes them
+#ifndef FONA_SMS_QUEUE
+#define FONA_SMS_QUEUE 8
+#endif
+
+// GNSS fix modes, the same values GPSstatus() returns
+#define FONA_GNSS_FIX_NONE 1
+#define FONA_GNSS_FIX_2D 2
+#define FONA_GNSS_FIX_3D 3
+
+// GPSrestart() modes, the AT+CGNSRST/AT+CGPSRST values
+#define FONA_GPS_COLD 0
+#define FONA_GPS_HOT 1
+#define FONA_GPS_WARM 2
+
+// Where downloadGPSAssist() stores EPO data on the 808 V2, and where to get
+// it from: 3 days of GPS orbits
+#define FONA_GPS_EPO_FILE "/customer/Xtra3.dat"
+#define FONA_GPS_EPO_URL "http://wepodownload.mediatek.com/EPO_GPS_3_1.DAT"
+
+/** Receives one chunk of an HTTP response body. Return false to stop. */
+typedef bool (*FONAHTTPReadCallback)(const uint8_t* data, uint16_t len,
+                                     uint32_t offset, void* context);
+/** A header in a response header block. Points into the caller's buffer;
+ * name and value are not NUL terminated. */
+typedef struct {
+  const char* name;  ///< Start of the header name
+  uint8_t namelen;   ///< Length of the header name
+  const char* value; ///< Start of the value, leading spaces skipped
+  uint16_t valuelen; ///< Length of the value, trailing spaces trimmed
+} FONAHTTPHeader;
+
+/** One cached response for HTTP_GET_cached(). Set up with
+ * HTTP_cacheInit(); the body lives in a buffer supplied by the caller. */
+typedef struct {
+  uint32_t urlhash;                      ///< Digest of the cached URL
+  uint32_t bodyhash;                     ///< Digest of the cached body
+  char etag[FONA_HTTP_ETAG_LEN];         ///< ETag of the cached body
+  char lastmodified[FONA_HTTP_DATE_LEN]; ///< Last-Modified of the body
+  uint8_t* body;                         ///< Buffer holding the body
+  uint16_t bodysize;                     ///< Size of the body buffer
+  uint16_t bodylen;                      ///< Cached body length
+  bool cached;                           ///< Whether the entry holds a body
+} FONAHTTPCacheEntry;
+
+/** Produces up to maxlen bytes of an HTTP request body at offset. Returns
+ * the number of bytes written to data, 0 if it has nothing more. */
+typedef uint16_t (*FONAHTTPWriteCallback)(uint8_t* data, uint16_t maxlen,
+                                          uint32_t offset, void* context);
+
+/** Writes a whole HTTP request body, e.g. with a FONACBOREncoder. Called
+ * twice per request, once to measure the body and once to send it, so it
+ * must write the same bytes both times. */
+typedef void (*FONAHTTPBodyCallback)(Print& out, void* context);
+
+/** A GNSS position fix in integer units, filled by FONANMEAParser */
+typedef struct {
+  int32_t lat_udeg;     ///< Latitude in microdegrees, north positive
+  int32_t lon_udeg;     ///< Longitude in microdegrees, east positive
+  int32_t alt_cm;       ///< Altitude above mean sea level in cm
+  uint16_t speed_cmps;  ///< Speed over ground in cm/s
+  uint16_t course_cdeg; ///< Course over ground in 1/100 degree
+  uint16_t hdop;        ///< Horizontal dilution of precision x100
+  uint8_t sats;         ///< Satellites used in the fix
+  uint8_t mode;         ///< FONA_GNSS_FIX_NONE, _2D or _3D
+  uint8_t year;         ///< UTC year since 2000
+  uint8_t month;        ///< UTC month, 1-12
+  uint8_t day;          ///< UTC day of the month
+  uint8_t hour;         ///< UTC hour
+  uint8_t minute;       ///< UTC minute
+  uint8_t second;       ///< UTC second
+  bool valid;           ///< true: the position is a current fix
+} FONAGnssFix;
+
+/** A stored SMS, as listed by AT+CMGL */
+typedef struct {
+  uint8_t index;                   ///< Storage index, for readSMS()
+  uint8_t status;                  ///< FONA_SMS_REC_UNREAD etc.
+  char address[FONA_SMS_ADDR_LEN]; ///< Sender, or recipient if sent
+  char timestamp[21];              ///< "yy/MM/dd,hh:mm:ss+zz", "" if unknown
+  uint16_t length;                 ///< Full body length
+} FONASMSHeader;
+
+/** One SMS memory, as reported by AT+CPMS? */
+typedef struct {
+  char name[5];   ///< Memory name, e.g. "SM" or "ME"
+  uint16_t used;  ///< Messages stored
+  uint16_t total; ///< Capacity
+} FONASMSMemory;
+
+/** Concatenation info from the user data header of a PDU mode SMS */
+typedef struct {
+  uint16_t ref;  ///< Reference shared by all parts of a message
+  uint8_t total; ///< Number of parts, 1 if not concatenated
+  uint8_t seq;   ///< This part, from 1
+} FONASMSConcat;
+
+/** Receives one listed SMS. body holds the first len bytes of the message,
+ * NUL terminated; header->length is the full length. Return false to skip
+ * the remaining messages. */
+typedef bool (*FONASMSCallback)(const FONASMSHeader* header, const char* body,
+                                uint16_t len, void* context);
+/** Receives one chunk of an SMS body read by readSMS(). Return false to
+ * discard the rest. */
+typedef bool (*FONASMSReadCallback)(const uint8_t* data, uint16_t len,
+                                    uint16_t offset, void* context);
+
 /** Object that controls and keeps state for the FONA module. */
 class Adafruit_FONA : public FONAStreamType {
  public:
@@ -106,12 +254,28 @@ class Adafruit_FONA : public FONAStreamType {
   // SMS handling
   bool setSMSInterrupt(uint8_t i);
   uint8_t getSMSInterrupt(void);
+  bool setSMSNotify(bool onoff);
+  int16_t getNewSMS(uint16_t timeout = 0);
   int8_t getNumSMS(void);
   bool readSMS(uint8_t message_index, char* smsbuff, uint16_t max,
                uint16_t* readsize);
+  bool readSMS(uint8_t message_index, FONASMSReadCallback callback,
+               void* context, uint16_t* smslen);
   bool sendSMS(char* smsaddr, char* smsmsg);
+  uint8_t sendSMSBurst(char** smsaddrs, uint8_t count, char* smsmsg,
+                       bool* results = 0);
   bool deleteSMS(uint8_t message_index);
+  bool deleteAllSMS(uint8_t flag = FONA_SMS_DEL_ALL);
+  bool getSMSStorage(FONASMSMemory* read, FONASMSMemory* write = 0,
+                     FONASMSMemory* receive = 0);
   bool getSMSSender(uint8_t message_index, char* sender, int senderlen);
+  int16_t listSMS(uint8_t status, FONASMSCallback callback, void* context,
+                  char* body, uint16_t bodylen);
+  bool sendSMSPDU(char* smsaddr, const char* text);
+  bool readSMSPDU(uint8_t message_index, FONASMSHeader* header,
+                  FONASMSConcat* concat, char* text, uint16_t maxlen);
+  bool readSMSConcat(uint8_t message_index, char* text, uint16_t maxlen,
+                     uint16_t* readlen);
   bool sendUSSD(char* ussdmsg, char* ussdbuff, uint16_t maxlen,
                 uint16_t* readlen);
 
@@ -124,6 +288,7 @@ class Adafruit_FONA : public FONAStreamType {
   bool enableGPRS(bool onoff);
   uint8_t GPRSstate(void);
   bool getGSMLoc(uint16_t* replycode, char* buff, uint16_t maxlen);
+  bool getGSMLoc(int32_t* lat_udeg, int32_t* lon_udeg);
   bool getGSMLoc(float* lat, float* lon);
   void setGPRSNetworkSettings(FONAFlashStringPtr apn,
                               FONAFlashStringPtr username = 0,
@@ -133,9 +298,15 @@ class Adafruit_FONA : public FONAStreamType {
   bool enableGPS(bool onoff);
   int8_t GPSstatus(void);
   uint8_t getGPS(uint8_t arg, char* buffer, uint8_t maxbuff);
+  bool readFix(FONAGnssFix* fix);
+  bool getGPS(int32_t* lat_udeg, int32_t* lon_udeg, uint16_t* speed_cmps = 0,
+              uint16_t* course_cdeg = 0, int32_t* alt_cm = 0);
   bool getGPS(float* lat, float* lon, float* speed_kph = 0, float* heading = 0,
               float* altitude = 0);
   bool enableGPSNMEA(uint8_t enable_value);
+  bool GPSrestart(uint8_t mode);
+  bool downloadGPSAssist(char* url, uint16_t* status, uint32_t* datalen);
+  bool enableGPSAssist(void);
 
   // TCP raw connections
   bool TCPconnect(char* server, uint16_t port);
@@ -144,6 +315,11 @@ class Adafruit_FONA : public FONAStreamType {
   bool TCPsend(char* data, uint8_t len);
   uint16_t TCPavailable(void);
   uint16_t TCPread(uint8_t* buff, uint8_t len);
+  bool TCPkeepalive(bool onoff, uint16_t idle = 60, uint16_t interval = 30,
+                    uint8_t count = 3);
+
+  // Unsolicited result codes
+  uint8_t pollURC(uint16_t timeout = 0, uint8_t mask = 0xFF);
 
   // HTTP low level interface (maps directly to SIM800 commands).
   bool HTTP_init();
@@ -156,21 +332,56 @@ class Adafruit_FONA : public FONAStreamType {
   bool HTTP_data(uint32_t size, uint32_t maxTime = 10000);
   bool HTTP_action(uint8_t method, uint16_t* status, uint16_t* datalen,
                    int32_t timeout = 10000);
+  bool HTTP_action(uint8_t method, uint16_t* status, uint32_t* datalen,
+                   int32_t timeout = 10000);
+  bool HTTP_action_start(uint8_t method, uint32_t timeout = 30000);
+  int8_t HTTP_action_poll(uint16_t* status, uint32_t* datalen);
   bool HTTP_readall(uint16_t* datalen);
+  uint16_t HTTP_read(uint32_t offset, uint8_t* buff, uint16_t len);
+  bool HTTP_readStream(uint32_t datalen, FONAHTTPReadCallback callback,
+                       void* context, uint8_t* buff, uint16_t bufflen);
   bool HTTP_ssl(bool onoff);
 
+  // HTTP headers
+  bool HTTP_addHeader(FONAFlashStringPtr name, const char* value);
+  void HTTP_clearHeaders(void);
+  uint16_t HTTP_readHeaders(char* buff, uint16_t maxlen);
+  static bool HTTP_nextHeader(const char** p, const char* end,
+                              FONAHTTPHeader* header);
+  static bool HTTP_findHeader(const char* headers, uint16_t len,
+                              FONAFlashStringPtr name, FONAHTTPHeader* header);
+
   // HTTP high level interface (easier to use, less flexible).
   bool HTTP_GET_start(char* url, uint16_t* status, uint16_t* datalen);
+  bool HTTP_GET_start(char* url, uint16_t* status, uint32_t* datalen);
+  bool HTTP_GET_async(char* url);
+  bool HTTP_GET_cached(char* url, FONAHTTPCacheEntry* entry, uint16_t* status,
+                       bool* changed);
+  static void HTTP_cacheInit(FONAHTTPCacheEntry* entry, uint8_t* body,
+                             uint16_t bodysize);
   void HTTP_GET_end(void);
   bool HTTP_POST_start(char* url, FONAFlashStringPtr contenttype,
                        const uint8_t* postdata, uint16_t postdatalen,
                        uint16_t* status, uint16_t* datalen);
+  bool HTTP_POST_start(char* url, FONAFlashStringPtr contenttype,
+                       FONAHTTPWriteCallback producer, void* context,
+                       uint32_t postdatalen, uint16_t* status,
+                       uint32_t* datalen);
+  bool HTTP_POST_start(char* url, FONAFlashStringPtr contenttype,
+                       FONAStreamType& source, uint32_t postdatalen,
+                       uint16_t* status, uint32_t* datalen);
+  bool HTTP_POST_start(char* url, FONAFlashStringPtr contenttype,
+                       FONAHTTPBodyCallback writer, void* context,
+                       uint16_t* status, uint32_t* datalen);
   void HTTP_POST_end(void);
   void setUserAgent(FONAFlashStringPtr useragent);
 
   // HTTPS
   void setHTTPSRedirect(bool onoff);
 
+  // HTTP session (keep HTTPINIT alive and only resend changed parameters)
+  void setHTTPSession(bool onoff);
+
   // PWM (buzzer)
   bool setPWM(uint16_t period, uint8_t duty = 50);
 
@@ -203,11 +414,46 @@ class Adafruit_FONA : public FONAStreamType {
   FONAFlashStringPtr useragent;   ///< User agent used when making requests
   FONAFlashStringPtr ok_reply;    ///< OK reply for successful requests
 
+  uint8_t urcflags;                   ///< Pending FONA_URC_* events
+  bool httpsession;                   ///< Keep HTTPINIT alive between requests
+  uint8_t httpcache;                  ///< HTTP parameters set on the module
+  uint32_t httpurlhash;               ///< Digest of the URL last sent
+  FONAFlashStringPtr httplastua;      ///< User agent last sent
+  FONAFlashStringPtr httplastcontent; ///< Content type last sent
+  uint8_t httpactionstate;            ///< Asynchronous HTTPACTION state
+  uint16_t httpactionstatus;          ///< Status from the +HTTPACTION URC
+  uint32_t httpactionlen;             ///< Length from the +HTTPACTION URC
+  uint32_t httpactionstart;           ///< millis() when HTTPACTION was accepted
+  uint32_t httpactionwait;            ///< How long to wait for the URC
+  uint8_t httpheaders;                ///< Number of queued request headers
+  uint32_t httpuserdatahash;          ///< Digest of the USERDATA last sent
+  uint8_t smsref;                     ///< Reference of the last long SMS
+  uint8_t smsqueuehead;               ///< Oldest entry in smsqueue
+  uint8_t smsqueuelen;                ///< Entries in smsqueue
+
+  FONAFlashStringPtr httpheadername[FONA_HTTP_MAX_HEADERS]; ///< Header names
+  const char* httpheadervalue[FONA_HTTP_MAX_HEADERS];       ///< Header values
+  uint8_t smsqueue[FONA_SMS_QUEUE]; ///< Indices of newly received SMS
+
   // HTTP helpers
   bool HTTP_setup(char* url);
+  bool HTTP_content(FONAFlashStringPtr contenttype);
+  void HTTP_readValidators(FONAHTTPCacheEntry* entry);
+
+  // SMS helpers
+  bool readSMSStart(uint8_t message_index, uint16_t* smslen);
+  bool sendSMSText(char* smsaddr, char* smsmsg);
+  bool smsSubmitEnd(void);
+  bool readPDU(uint8_t message_index, FONASMSHeader* header,
+               FONASMSConcat* concat, char* text, uint16_t maxlen);
+  bool findSMSParts(const char* address, const FONASMSConcat* concat,
+                    uint8_t* parts);
 
   void flushInput();
+  void handleURC(const char* line);
+  void readURCs(void);
   uint16_t readRaw(uint16_t read_length);
+  uint16_t readRaw(uint8_t* buff, uint16_t read_length, uint16_t timeout);
   uint8_t readline(uint16_t timeout = FONA_DEFAULT_TIMEOUT_MS,
                    bool multiline = false);
   uint8_t getReply(char* send, uint16_t timeout = FONA_DEFAULT_TIMEOUT_MS);
@@ -238,6 +484,8 @@ class Adafruit_FONA : public FONAStreamType {
 
   bool parseReply(FONAFlashStringPtr toreply, uint16_t* v, char divider = ',',
                   uint8_t index = 0);
+  bool parseReply(FONAFlashStringPtr toreply, uint32_t* v, char divider = ',',
+                  uint8_t index = 0);
   bool parseReply(FONAFlashStringPtr toreply, char* v, char divider = ',',
                   uint8_t index = 0);
   bool parseReplyQuoted(FONAFlashStringPtr toreply, char* v, int maxlen,
@@ -251,6 +499,27 @@ class Adafruit_FONA : public FONAStreamType {
 
   FONAStreamType* mySerial; ///< Serial connection
 };
+/** Print that only counts what is written to it, for sizing a request
+ * before streaming it to the module */
+class FONACountingPrint : public Print {
+ public:
+  FONACountingPrint(void) : count(0) {}
+  size_t write(uint8_t c) {
+    (void)c;
+    count++;
+    return 1;
+  }
+  size_t write(const uint8_t* buffer, size_t size) {
+    (void)buffer;
+    count += size;
+    return size;
+  }
+
+  uint32_t count; ///< Bytes written so far
+};
+
+class FONAHTTPResponseParser;
+
 /** Object that controls and keeps state for a 3G FONA module. */
 class Adafruit_FONA_3G : public Adafruit_FONA {
  public:
@@ -270,10 +539,60 @@ class Adafruit_FONA_3G : public Adafruit_FONA {
   bool enableGPRS(bool onoff);
   bool enableGPS(bool onoff);
 
+  // HTTP
+  bool HTTP_GET(char* url, uint16_t* status,
+                FONAHTTPReadCallback callback = 0, void* context = 0);
+  bool HTTP_POST(char* url, FONAFlashStringPtr contenttype,
+                 FONAHTTPWriteCallback producer, void* pcontext,
+                 uint32_t postdatalen, uint16_t* status,
+                 FONAHTTPReadCallback callback = 0, void* context = 0);
+
+  // The SIM800 AT+HTTP* interface is not available on the SIM5320
+  bool HTTP_action(uint8_t method, uint16_t* status, uint16_t* datalen,
+                   int32_t timeout = 10000);
+  bool HTTP_action(uint8_t method, uint16_t* status, uint32_t* datalen,
+                   int32_t timeout = 10000);
+  bool HTTP_action_start(uint8_t method, uint32_t timeout = 30000);
+  bool HTTP_GET_start(char* url, uint16_t* status, uint16_t* datalen);
+  bool HTTP_GET_start(char* url, uint16_t* status, uint32_t* datalen);
+  bool HTTP_GET_async(char* url);
+  bool HTTP_GET_cached(char* url, FONAHTTPCacheEntry* entry, uint16_t* status,
+                       bool* changed);
+  bool HTTP_POST_start(char* url, FONAFlashStringPtr contenttype,
+                       const uint8_t* postdata, uint16_t postdatalen,
+                       uint16_t* status, uint16_t* datalen);
+  bool HTTP_POST_start(char* url, FONAFlashStringPtr contenttype,
+                       FONAHTTPWriteCallback producer, void* context,
+                       uint32_t postdatalen, uint16_t* status,
+                       uint32_t* datalen);
+  bool HTTP_POST_start(char* url, FONAFlashStringPtr contenttype,
+                       FONAStreamType& source, uint32_t postdatalen,
+                       uint16_t* status, uint32_t* datalen);
+  bool HTTP_POST_start(char* url, FONAFlashStringPtr contenttype,
+                       FONAHTTPBodyCallback writer, void* context,
+                       uint16_t* status, uint32_t* datalen);
+
  protected:
   bool parseReply(FONAFlashStringPtr toreply, float* f, char divider,
                   uint8_t index);
 
+  bool HTTP_request(FONAFlashStringPtr method, char* url,
+                    FONAFlashStringPtr contenttype,
+                    FONAHTTPWriteCallback producer, void* pcontext,
+                    uint32_t postdatalen, FONAHTTPResponseParser* parser);
+  void HTTP_writeHead(Print& out, FONAFlashStringPtr method,
+                      const char* host, uint8_t hostlen, uint16_t port,
+                      const char* path, FONAFlashStringPtr contenttype,
+                      uint32_t postdatalen);
+  bool HTTP_writeBody(FONAHTTPWriteCallback producer, void* context,
+                      uint32_t offset, uint32_t len);
+  bool HTTP_feed(uint32_t len, FONAHTTPResponseParser* parser);
+  bool HTTP_receive(FONAHTTPResponseParser* parser);
+  bool HTTPS_open(const char* host, uint8_t hostlen, uint16_t port);
+  bool HTTPS_send(uint16_t len);
+  bool HTTPS_receive(FONAHTTPResponseParser* parser, uint32_t timeout);
+  void HTTPS_close(void);
+
   bool sendParseReply(FONAFlashStringPtr tosend, FONAFlashStringPtr toreply,
                       float* f, char divider = ',', uint8_t index = 0);
 };
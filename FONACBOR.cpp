@@ -0,0 +1,316 @@
+/*!
+ * @file FONACBOR.cpp
+ *
+ * Streaming CBOR (RFC 8949) encoder for compact telemetry payloads. Items
+ * are written straight to a Print, such as the module's serial port during
+ * AT+HTTPDATA or a FONATCPWriter, so nothing is buffered.
+ *
+ * BSD license, all text above must be included in any redistribution
+ */
+
+#include "FONACBOR.h"
+
+// Major types
+#define FONA_CBOR_UINT 0
+#define FONA_CBOR_NEGINT 1
+#define FONA_CBOR_BYTES 2
+#define FONA_CBOR_TEXT 3
+#define FONA_CBOR_ARRAY 4
+#define FONA_CBOR_MAP 5
+#define FONA_CBOR_TAG 6
+#define FONA_CBOR_SIMPLE 7
+
+// Additional information for indefinite length containers
+#define FONA_CBOR_INDEFINITE 31
+
+/**
+ * @brief Construct a new FONACBOREncoder object
+ *
+ * @param out Where to write the encoded items
+ */
+FONACBOREncoder::FONACBOREncoder(Print& out) {
+  _out = &out;
+}
+
+/**
+ * @brief Write an item head in the shortest form that holds the value
+ *
+ * @param major The major type
+ * @param v The count, length or value
+ */
+void FONACBOREncoder::head(uint8_t major, uint32_t v) {
+  major <<= 5;
+  if (v < 24) {
+    _out->write(major | v);
+  } else if (v <= 0xFF) {
+    _out->write(major | 24);
+    _out->write((uint8_t)v);
+  } else if (v <= 0xFFFF) {
+    _out->write(major | 25);
+    _out->write((uint8_t)(v >> 8));
+    _out->write((uint8_t)v);
+  } else {
+    _out->write(major | 26);
+    _out->write((uint8_t)(v >> 24));
+    _out->write((uint8_t)(v >> 16));
+    _out->write((uint8_t)(v >> 8));
+    _out->write((uint8_t)v);
+  }
+}
+
+/**
+ * @brief Write an unsigned integer
+ *
+ * @param v The value
+ */
+void FONACBOREncoder::writeUInt(uint32_t v) {
+  head(FONA_CBOR_UINT, v);
+}
+
+/**
+ * @brief Write a signed integer
+ *
+ * @param v The value
+ */
+void FONACBOREncoder::writeInt(int32_t v) {
+  if (v < 0)
+    head(FONA_CBOR_NEGINT, (uint32_t)(-1 - v));
+  else
+    head(FONA_CBOR_UINT, v);
+}
+
+/**
+ * @brief Write true or false
+ *
+ * @param v The value
+ */
+void FONACBOREncoder::writeBool(bool v) {
+  head(FONA_CBOR_SIMPLE, v ? 21 : 20);
+}
+
+/**
+ * @brief Write null, for values that are not available
+ *
+ */
+void FONACBOREncoder::writeNull(void) {
+  head(FONA_CBOR_SIMPLE, 22);
+}
+
+/**
+ * @brief Write a single precision float
+ *
+ * @param v The value
+ */
+void FONACBOREncoder::writeFloat(float v) {
+  uint32_t bits;
+  memcpy(&bits, &v, sizeof(bits));
+
+  _out->write((FONA_CBOR_SIMPLE << 5) | 26);
+  _out->write((uint8_t)(bits >> 24));
+  _out->write((uint8_t)(bits >> 16));
+  _out->write((uint8_t)(bits >> 8));
+  _out->write((uint8_t)bits);
+}
+
+/**
+ * @brief Write a text string
+ *
+ * @param s The string
+ */
+void FONACBOREncoder::writeString(const char* s) {
+  writeString(s, strlen(s));
+}
+
+/**
+ * @brief Write a text string that isn't terminated
+ *
+ * @param s Pointer to the first character
+ * @param len The length of the string
+ */
+void FONACBOREncoder::writeString(const char* s, uint16_t len) {
+  head(FONA_CBOR_TEXT, len);
+  _out->write((const uint8_t*)s, len);
+}
+
+/**
+ * @brief Write a text string stored in flash, such as a map key
+ *
+ * @param s The string
+ */
+void FONACBOREncoder::writeString(FONAFlashStringPtr s) {
+  head(FONA_CBOR_TEXT, prog_char_strlen((prog_char*)s));
+  _out->print(s);
+}
+
+/**
+ * @brief Write a byte string
+ *
+ * @param data Pointer to the bytes
+ * @param len The number of bytes
+ */
+void FONACBOREncoder::writeBytes(const uint8_t* data, uint16_t len) {
+  head(FONA_CBOR_BYTES, len);
+  _out->write(data, len);
+}
+
+/**
+ * @brief Write a tag, which applies to the next item
+ *
+ * @param tag The tag number
+ */
+void FONACBOREncoder::writeTag(uint32_t tag) {
+  head(FONA_CBOR_TAG, tag);
+}
+
+/**
+ * @brief Start an array of a known size
+ *
+ * @param items The number of items that follow
+ */
+void FONACBOREncoder::beginArray(uint16_t items) {
+  head(FONA_CBOR_ARRAY, items);
+}
+
+/**
+ * @brief Start an array whose size isn't known yet, closed with end()
+ *
+ */
+void FONACBOREncoder::beginArray(void) {
+  _out->write((FONA_CBOR_ARRAY << 5) | FONA_CBOR_INDEFINITE);
+}
+
+/**
+ * @brief Start a map of a known size
+ *
+ * @param pairs The number of key/value pairs that follow
+ */
+void FONACBOREncoder::beginMap(uint16_t pairs) {
+  head(FONA_CBOR_MAP, pairs);
+}
+
+/**
+ * @brief Start a map whose size isn't known yet, closed with end()
+ *
+ */
+void FONACBOREncoder::beginMap(void) {
+  _out->write((FONA_CBOR_MAP << 5) | FONA_CBOR_INDEFINITE);
+}
+
+/**
+ * @brief Close the innermost array or map started without a size
+ *
+ */
+void FONACBOREncoder::end(void) {
+  _out->write(0xFF);
+}
+
+/**
+ * @brief Write an exact decimal number, mantissa * 10^exponent, as a tag 4
+ * decimal fraction
+ *
+ * @param mantissa The digits
+ * @param exponent The power of ten, -6 for a value in millionths
+ */
+void FONACBOREncoder::writeDecimal(int32_t mantissa, int8_t exponent) {
+  writeTag(4);
+  beginArray(2);
+  writeInt(exponent);
+  writeInt(mantissa);
+}
+
+/**
+ * @brief Write a position from getGPS() as a [latitude, longitude] array of
+ * floats. A float holds about 7 digits, so this rounds to roughly a meter;
+ * use writeLocationE6() to keep every digit the module reports.
+ *
+ * @param lat The latitude in degrees
+ * @param lon The longitude in degrees
+ */
+void FONACBOREncoder::writeLocation(float lat, float lon) {
+  beginArray(2);
+  writeFloat(lat);
+  writeFloat(lon);
+}
+
+/**
+ * @brief Write a position in microdegrees, as from the int32_t getGPS() or
+ * readFix(), as a [latitude, longitude] array of exact decimal fractions
+ *
+ * @param lat_udeg The latitude in microdegrees
+ * @param lon_udeg The longitude in microdegrees
+ */
+void FONACBOREncoder::writeLocationE6(int32_t lat_udeg, int32_t lon_udeg) {
+  beginArray(2);
+  writeDecimal(lat_udeg, -6);
+  writeDecimal(lon_udeg, -6);
+}
+
+/**
+ * @brief Write a battery voltage from getBattVoltage()
+ *
+ * @param mv The voltage in mV
+ */
+void FONACBOREncoder::writeBattery(uint16_t mv) {
+  writeUInt(mv);
+}
+
+/**
+ * @brief Write the signal strength from getRSSI() in dBm, or null if it is
+ * not known
+ *
+ * @param rssi The AT+CSQ value, 0-31 or 99
+ */
+void FONACBOREncoder::writeRSSI(uint8_t rssi) {
+  if (rssi > 31) {
+    writeNull();
+    return;
+  }
+
+  int8_t dbm;
+  if (rssi == 0)
+    dbm = -115;
+  else if (rssi == 1)
+    dbm = -111;
+  else if (rssi == 31)
+    dbm = -52;
+  else
+    dbm = -110 + 2 * (rssi - 2);
+  writeInt(dbm);
+}
+
+/**
+ * @brief Write a time as a tag 1 epoch timestamp
+ *
+ * @param epoch Seconds since 1970-01-01 00:00:00 UTC
+ */
+void FONACBOREncoder::writeTimestamp(uint32_t epoch) {
+  writeTag(1);
+  writeUInt(epoch);
+}
+
+/**
+ * @brief Write a time as a tag 1 epoch timestamp
+ *
+ * @param year The year after 2000, as the module reports it
+ * @param month The month, 1-12
+ * @param day The day of the month, 1-31
+ * @param hr The hour, 0-23
+ * @param min The minute, 0-59
+ * @param sec The second, 0-59
+ */
+void FONACBOREncoder::writeTimestamp(uint8_t year, uint8_t month,
+                                     uint8_t day, uint8_t hr, uint8_t min,
+                                     uint8_t sec) {
+  static const uint16_t monthdays[12] = {0,   31,  59,  90,  120, 151,
+                                         181, 212, 243, 273, 304, 334};
+
+  // days from 1970 to 2000, then whole years and the leap days before them
+  uint32_t days = 10957UL + 365UL * year + (year + 3) / 4;
+  if ((month >= 1) && (month <= 12))
+    days += monthdays[month - 1];
+  if ((month > 2) && ((year % 4) == 0))
+    days++;
+  days += day - 1;
+
+  writeTimestamp(((days * 24 + hr) * 60 + min) * 60 + sec);
+}
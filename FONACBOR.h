@@ -0,0 +1,54 @@
+/*!
+ * @file FONACBOR.h
+ *
+ * Streaming CBOR (RFC 8949) encoder for compact telemetry payloads. Items
+ * are written straight to a Print, such as the module's serial port during
+ * AT+HTTPDATA or a FONATCPWriter, so nothing is buffered.
+ *
+ * BSD license, all text above must be included in any redistribution
+ */
+#ifndef FONA_CBOR_H
+#define FONA_CBOR_H
+
+#include "Adafruit_FONA.h"
+
+/** Streaming CBOR encoder. Containers opened with a count need exactly that
+ * many items (pairs for maps); ones opened without need a matching end(). */
+class FONACBOREncoder {
+ public:
+  FONACBOREncoder(Print& out);
+
+  void writeUInt(uint32_t v);
+  void writeInt(int32_t v);
+  void writeBool(bool v);
+  void writeNull(void);
+  void writeFloat(float v);
+  void writeString(const char* s);
+  void writeString(const char* s, uint16_t len);
+  void writeString(FONAFlashStringPtr s);
+  void writeBytes(const uint8_t* data, uint16_t len);
+  void writeTag(uint32_t tag);
+
+  void beginArray(uint16_t items);
+  void beginArray(void);
+  void beginMap(uint16_t pairs);
+  void beginMap(void);
+  void end(void);
+
+  // values the driver produces
+  void writeDecimal(int32_t mantissa, int8_t exponent);
+  void writeLocation(float lat, float lon);
+  void writeLocationE6(int32_t lat_udeg, int32_t lon_udeg);
+  void writeBattery(uint16_t mv);
+  void writeRSSI(uint8_t rssi);
+  void writeTimestamp(uint32_t epoch);
+  void writeTimestamp(uint8_t year, uint8_t month, uint8_t day, uint8_t hr,
+                      uint8_t min, uint8_t sec);
+
+ private:
+  void head(uint8_t major, uint32_t v);
+
+  Print* _out;
+};
+
+#endif
@@ -0,0 +1,313 @@
+/*!
+ * @file FONADeflate.cpp
+ *
+ * Streaming gzip compressor for upload payloads. It sits between the code
+ * producing a body and the Print it would have written to (the module's
+ * serial port during AT+HTTPDATA, a FONATCPWriter, a FONACountingPrint) and
+ * needs well under 1 KB of RAM.
+ *
+ * BSD license, all text above must be included in any redistribution
+ */
+
+#include "FONADeflate.h"
+
+#define FONA_DEFLATE_MASK (FONA_DEFLATE_WINDOW - 1)
+
+// Farthest back a match may start while the lookahead is still in the window
+#define FONA_DEFLATE_MAX_DIST (FONA_DEFLATE_WINDOW - FONA_DEFLATE_LOOKAHEAD)
+
+// Hash chain entries tried for each match
+#define FONA_DEFLATE_CHAIN 8
+
+// CRC-32 (polynomial 0xEDB88320) four bits at a time
+static const uint32_t crctable[16] PROGMEM = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4,
+    0x4DB26158, 0x5005713C, 0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+    0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C};
+
+/**
+ * @brief Find the highest set bit
+ *
+ * @param v The value, not 0
+ * @return uint8_t The bit number
+ */
+static uint8_t highBit(uint8_t v) {
+  uint8_t n = 0;
+  while (v >>= 1)
+    n++;
+  return n;
+}
+
+/**
+ * @brief Construct a new FONADeflate object
+ *
+ * @param out Where to write the compressed stream
+ */
+FONADeflate::FONADeflate(Print& out) {
+  _out = &out;
+  _pos = 0;
+  _end = 0;
+  _crc = 0;
+  _bits = 0;
+  _nbits = 0;
+}
+
+/**
+ * @brief Start a new gzip stream
+ *
+ */
+void FONADeflate::begin(void) {
+  memset(_head, 0, sizeof(_head));
+  _pos = 0;
+  _end = 0;
+  _crc = 0xFFFFFFFFUL;
+  _bits = 0;
+  _nbits = 0;
+
+  // ID1, ID2, CM=deflate, no flags, no time, no extra flags, unknown OS
+  static const uint8_t header[10] = {0x1F, 0x8B, 8, 0, 0, 0, 0, 0, 0, 0xFF};
+  _out->write(header, sizeof(header));
+
+  // one fixed Huffman block for everything up to finish()
+  putBits(0, 1);
+  putBits(1, 2);
+}
+
+/**
+ * @brief Compress a byte. Output lags the input by up to
+ * FONA_DEFLATE_LOOKAHEAD bytes until finish().
+ *
+ * @param c The byte to write
+ * @return size_t 1
+ */
+size_t FONADeflate::write(uint8_t c) {
+  _window[_end & FONA_DEFLATE_MASK] = c;
+  _end++;
+
+  _crc ^= c;
+  _crc = (_crc >> 4) ^ pgm_read_dword(&crctable[_crc & 0x0F]);
+  _crc = (_crc >> 4) ^ pgm_read_dword(&crctable[_crc & 0x0F]);
+
+  if (_end - _pos >= FONA_DEFLATE_LOOKAHEAD)
+    encode();
+  return 1;
+}
+
+/**
+ * @brief Compress what is left and write the gzip trailer
+ *
+ */
+void FONADeflate::finish(void) {
+  while (_pos < _end)
+    encode();
+  putLiteral(256);
+
+  // an empty final block marks the end of the stream
+  putBits(1, 1);
+  putBits(1, 2);
+  putLiteral(256);
+  flushBits();
+
+  put32(~_crc);
+  put32(_end);
+}
+
+/**
+ * @brief Get the number of bytes written so far, before compression
+ *
+ * @return uint32_t The uncompressed size
+ */
+uint32_t FONADeflate::size(void) {
+  return _end;
+}
+
+/**
+ * @brief Add a Content-Encoding: gzip header to the following HTTP requests,
+ * until HTTP_clearHeaders() is called
+ *
+ * @param fona The module the requests are sent with
+ * @return true: success, false: FONA_HTTP_MAX_HEADERS are already queued
+ */
+bool FONADeflate::setContentEncoding(Adafruit_FONA& fona) {
+  static const char gzip[] = "gzip";
+  return fona.HTTP_addHeader(F("Content-Encoding"), gzip);
+}
+
+/**
+ * @brief Encode the byte at _pos, as a literal or as the longest match found
+ * along its hash chain
+ *
+ */
+void FONADeflate::encode(void) {
+  uint8_t avail = _end - _pos;
+  uint8_t best = 0;
+  uint8_t bestdist = 0;
+
+  if (avail >= 3) {
+    uint32_t maxdist = (_pos < FONA_DEFLATE_MAX_DIST) ? _pos
+                                                       : FONA_DEFLATE_MAX_DIST;
+    uint32_t cand = _head[hash(_pos)];
+
+    // chain entries can be stale, so every candidate is checked byte by byte
+    for (uint8_t i = 0; cand && (i < FONA_DEFLATE_CHAIN); i++) {
+      uint32_t dist = _pos + 1 - cand;
+      if ((dist == 0) || (dist > maxdist))
+        break;
+
+      uint32_t p = cand - 1;
+      uint8_t len = 0;
+      while ((len < avail) && (_window[(p + len) & FONA_DEFLATE_MASK] ==
+                               _window[(_pos + len) & FONA_DEFLATE_MASK]))
+        len++;
+      if (len > best) {
+        best = len;
+        bestdist = dist;
+        if (len == avail)
+          break;
+      }
+
+      uint8_t step = _prev[p & FONA_DEFLATE_MASK];
+      if (step == 0)
+        break;
+      cand -= step;
+    }
+  }
+
+  uint8_t n = 1;
+  if (best >= 3) {
+    putMatch(best, bestdist);
+    n = best;
+  } else {
+    putLiteral(_window[_pos & FONA_DEFLATE_MASK]);
+  }
+
+  while (n--) {
+    if (_pos + 2 < _end)
+      insert(_pos);
+    _pos++;
+  }
+}
+
+/**
+ * @brief Add a position to its hash chain
+ *
+ * @param pos The position, with at least three bytes available from it
+ */
+void FONADeflate::insert(uint32_t pos) {
+  uint8_t h = hash(pos);
+  uint32_t last = _head[h];
+
+  // _head holds position + 1 so that 0 means empty
+  uint8_t step = 0;
+  if (last && (pos + 1 - last < FONA_DEFLATE_WINDOW))
+    step = pos + 1 - last;
+  _prev[pos & FONA_DEFLATE_MASK] = step;
+  _head[h] = pos + 1;
+}
+
+/**
+ * @brief Hash the three bytes starting at a position
+ *
+ * @param pos The position
+ * @return uint8_t The hash chain to use
+ */
+uint8_t FONADeflate::hash(uint32_t pos) {
+  uint8_t a = _window[pos & FONA_DEFLATE_MASK];
+  uint8_t b = _window[(pos + 1) & FONA_DEFLATE_MASK];
+  uint8_t c = _window[(pos + 2) & FONA_DEFLATE_MASK];
+  return ((a << 4) ^ (b << 2) ^ c ^ (a >> 4)) & (FONA_DEFLATE_HASH - 1);
+}
+
+/**
+ * @brief Write bits, least significant first
+ *
+ * @param bits The bits
+ * @param count How many bits
+ */
+void FONADeflate::putBits(uint16_t bits, uint8_t count) {
+  _bits |= (uint32_t)bits << _nbits;
+  _nbits += count;
+  while (_nbits >= 8) {
+    _out->write((uint8_t)_bits);
+    _bits >>= 8;
+    _nbits -= 8;
+  }
+}
+
+/**
+ * @brief Write a Huffman code, which goes most significant bit first
+ *
+ * @param code The code
+ * @param count The code length
+ */
+void FONADeflate::putCode(uint16_t code, uint8_t count) {
+  uint16_t reversed = 0;
+  for (uint8_t i = 0; i < count; i++) {
+    reversed = (reversed << 1) | (code & 1);
+    code >>= 1;
+  }
+  putBits(reversed, count);
+}
+
+/**
+ * @brief Write a literal/length symbol with the fixed Huffman code
+ *
+ * @param lit The symbol, 0-287
+ */
+void FONADeflate::putLiteral(uint16_t lit) {
+  if (lit < 144)
+    putCode(0x30 + lit, 8);
+  else if (lit < 256)
+    putCode(0x190 + lit - 144, 9);
+  else if (lit < 280)
+    putCode(lit - 256, 7);
+  else
+    putCode(0xC0 + lit - 280, 8);
+}
+
+/**
+ * @brief Write a length/distance pair
+ *
+ * @param len The match length, 3-FONA_DEFLATE_LOOKAHEAD
+ * @param dist The match distance, 1-255
+ */
+void FONADeflate::putMatch(uint8_t len, uint8_t dist) {
+  uint8_t n = len - 3;
+  if (n < 8) {
+    putLiteral(257 + n);
+  } else {
+    uint8_t extra = highBit(n) - 2;
+    putLiteral(261 + 4 * extra + ((n >> extra) & 3));
+    putBits(n & ((1 << extra) - 1), extra);
+  }
+
+  n = dist - 1;
+  if (n < 4) {
+    putCode(n, 5);
+  } else {
+    uint8_t extra = highBit(n) - 1;
+    putCode(2 * extra + 2 + ((n >> extra) & 1), 5);
+    putBits(n & ((1 << extra) - 1), extra);
+  }
+}
+
+/**
+ * @brief Pad the last bits out to a whole byte
+ *
+ */
+void FONADeflate::flushBits(void) {
+  if (_nbits)
+    putBits(0, 8 - _nbits);
+}
+
+/**
+ * @brief Write a little endian 32 bit value
+ *
+ * @param v The value
+ */
+void FONADeflate::put32(uint32_t v) {
+  for (uint8_t i = 0; i < 4; i++) {
+    _out->write((uint8_t)v);
+    v >>= 8;
+  }
+}
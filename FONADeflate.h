@@ -0,0 +1,66 @@
+/*!
+ * @file FONADeflate.h
+ *
+ * Streaming gzip compressor for upload payloads. It sits between the code
+ * producing a body and the Print it would have written to (the module's
+ * serial port during AT+HTTPDATA, a FONATCPWriter, a FONACountingPrint) and
+ * needs well under 1 KB of RAM.
+ *
+ * BSD license, all text above must be included in any redistribution
+ */
+#ifndef FONA_DEFLATE_H
+#define FONA_DEFLATE_H
+
+#include "Adafruit_FONA.h"
+
+// History searched for matches. A power of two, at most 256 so match
+// distances fit the uint8_t hash chains.
+#ifndef FONA_DEFLATE_WINDOW
+#define FONA_DEFLATE_WINDOW 256
+#endif
+
+// Bytes held back to look for a match, which is also the longest match
+#define FONA_DEFLATE_LOOKAHEAD 32
+
+// Hash chain heads, a power of two
+#define FONA_DEFLATE_HASH 64
+
+/** Print filter that gzip compresses everything written to it, using LZ77
+ * over a small window and the fixed DEFLATE Huffman codes. Call begin()
+ * before writing and finish() after the last byte. */
+class FONADeflate : public Print {
+ public:
+  FONADeflate(Print& out);
+
+  void begin(void);
+  size_t write(uint8_t c);
+  using Print::write;
+  void finish(void);
+
+  uint32_t size(void);
+
+  static bool setContentEncoding(Adafruit_FONA& fona);
+
+ private:
+  void encode(void);
+  void insert(uint32_t pos);
+  uint8_t hash(uint32_t pos);
+  void putBits(uint16_t bits, uint8_t count);
+  void putCode(uint16_t code, uint8_t count);
+  void putLiteral(uint16_t lit);
+  void putMatch(uint8_t len, uint8_t dist);
+  void flushBits(void);
+  void put32(uint32_t v);
+
+  Print* _out;
+  uint8_t _window[FONA_DEFLATE_WINDOW];
+  uint8_t _prev[FONA_DEFLATE_WINDOW];
+  uint32_t _head[FONA_DEFLATE_HASH];
+  uint32_t _pos;
+  uint32_t _end;
+  uint32_t _crc;
+  uint32_t _bits;
+  uint8_t _nbits;
+};
+
+#endif
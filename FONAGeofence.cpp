@@ -0,0 +1,342 @@
+/*!
+ * @file FONAGeofence.cpp
+ *
+ * Geofencing over many polygons and circles. A grid over the fences'
+ * bounding boxes is built once, so each fix is only tested against the
+ * fences whose box covers its cell, and enter/exit events are reported
+ * through a callback.
+ *
+ * BSD license, all text above must be included in any redistribution
+ */
+
+#include "FONAGeofence.h"
+
+// Meters per microdegree of latitude
+#define FONA_FENCE_M_PER_UDEG 0.11132
+
+/**
+ * @brief Get the meters per microdegree of longitude at a latitude
+ *
+ * @param lat_udeg The latitude
+ * @return float Meters per microdegree, never less than 1/100 of the value
+ * at the equator
+ */
+static float lonScale(int32_t lat_udeg) {
+  float c = cos(lat_udeg * (M_PI / 180e6));
+  return FONA_FENCE_M_PER_UDEG * ((c < 0.01) ? 0.01 : c);
+}
+
+/**
+ * @brief Get the bounding box of a fence
+ *
+ * @param fence The fence
+ * @param min Set to the south west corner
+ * @param max Set to the north east corner
+ */
+static void fenceBounds(const FONAGeofence* fence, FONAGeoPoint* min,
+                        FONAGeoPoint* max) {
+  if (fence->type == FONA_FENCE_CIRCLE) {
+    int32_t dlat = fence->radius_m / FONA_FENCE_M_PER_UDEG + 1;
+    int32_t dlon = fence->radius_m / lonScale(fence->center.lat_udeg) + 1;
+    min->lat_udeg = fence->center.lat_udeg - dlat;
+    max->lat_udeg = fence->center.lat_udeg + dlat;
+    min->lon_udeg = fence->center.lon_udeg - dlon;
+    max->lon_udeg = fence->center.lon_udeg + dlon;
+    return;
+  }
+
+  *min = *max = fence->vertices[0];
+  for (uint16_t i = 1; i < fence->count; i++) {
+    const FONAGeoPoint* v = &fence->vertices[i];
+    if (v->lat_udeg < min->lat_udeg)
+      min->lat_udeg = v->lat_udeg;
+    if (v->lat_udeg > max->lat_udeg)
+      max->lat_udeg = v->lat_udeg;
+    if (v->lon_udeg < min->lon_udeg)
+      min->lon_udeg = v->lon_udeg;
+    if (v->lon_udeg > max->lon_udeg)
+      max->lon_udeg = v->lon_udeg;
+  }
+}
+
+/**
+ * @brief Lay a grid over the bounding boxes of all fences
+ *
+ * @param fences The fences
+ * @param count The number of fences
+ * @param grid Cells along each side
+ * @param min Set to the south west corner of the grid
+ * @param cellh Set to the cell height in microdegrees
+ * @param cellw Set to the cell width in microdegrees
+ */
+static void gridLayout(const FONAGeofence* fences, uint16_t count,
+                       uint8_t grid, FONAGeoPoint* min, int32_t* cellh,
+                       int32_t* cellw) {
+  FONAGeoPoint max, fmin, fmax;
+  fenceBounds(&fences[0], min, &max);
+  for (uint16_t f = 1; f < count; f++) {
+    fenceBounds(&fences[f], &fmin, &fmax);
+    if (fmin.lat_udeg < min->lat_udeg)
+      min->lat_udeg = fmin.lat_udeg;
+    if (fmax.lat_udeg > max.lat_udeg)
+      max.lat_udeg = fmax.lat_udeg;
+    if (fmin.lon_udeg < min->lon_udeg)
+      min->lon_udeg = fmin.lon_udeg;
+    if (fmax.lon_udeg > max.lon_udeg)
+      max.lon_udeg = fmax.lon_udeg;
+  }
+
+  *cellh = (max.lat_udeg - min->lat_udeg) / grid + 1;
+  *cellw = (max.lon_udeg - min->lon_udeg) / grid + 1;
+}
+
+/**
+ * @brief Get the rows and columns of the grid a fence's bounding box covers
+ *
+ * @param fence The fence
+ * @param min South west corner of the grid
+ * @param cellh Cell height in microdegrees
+ * @param cellw Cell width in microdegrees
+ * @param rows Set to the first and last row
+ * @param cols Set to the first and last column
+ */
+static void fenceCells(const FONAGeofence* fence, const FONAGeoPoint* min,
+                       int32_t cellh, int32_t cellw, uint8_t* rows,
+                       uint8_t* cols) {
+  FONAGeoPoint fmin, fmax;
+  fenceBounds(fence, &fmin, &fmax);
+  rows[0] = (fmin.lat_udeg - min->lat_udeg) / cellh;
+  rows[1] = (fmax.lat_udeg - min->lat_udeg) / cellh;
+  cols[0] = (fmin.lon_udeg - min->lon_udeg) / cellw;
+  cols[1] = (fmax.lon_udeg - min->lon_udeg) / cellw;
+}
+
+/**
+ * @brief Construct a new FONAGeofences object
+ *
+ */
+FONAGeofences::FONAGeofences(void) {
+  _fences = 0;
+  _count = 0;
+  _grid = 0;
+  _lastcell = -1;
+  _callback = 0;
+  _context = 0;
+}
+
+/**
+ * @brief Get the buffer begin() needs for a set of fences. Smaller fences
+ * and a coarser grid need less.
+ *
+ * @param fences The fences
+ * @param count The number of fences
+ * @param grid Cells along each side of the grid
+ * @return uint32_t The number of uint16_t in the buffer
+ */
+uint32_t FONAGeofences::bufferSize(const FONAGeofence* fences,
+                                   uint16_t count, uint8_t grid) {
+  if (!count || !grid)
+    return 0;
+
+  FONAGeoPoint min;
+  int32_t cellh, cellw;
+  gridLayout(fences, count, grid, &min, &cellh, &cellw);
+
+  uint32_t entries = 0;
+  uint8_t rows[2], cols[2];
+  for (uint16_t f = 0; f < count; f++) {
+    fenceCells(&fences[f], &min, cellh, cellw, rows, cols);
+    entries += (uint32_t)(rows[1] - rows[0] + 1) * (cols[1] - cols[0] + 1);
+  }
+
+  return (uint32_t)grid * grid + 1 + entries + (count + 15) / 16;
+}
+
+/**
+ * @brief Build the grid index. The fences start out as not containing the
+ * position.
+ *
+ * @param fences The fences, kept by the caller while the index is in use
+ * @param count The number of fences
+ * @param grid Cells along each side of the grid, e.g. 8 to 32
+ * @param buffer Buffer for the index
+ * @param buflen The number of uint16_t in the buffer, see bufferSize()
+ * @return true: success, false: the buffer is too small, or the index
+ * would have more than 65535 entries
+ */
+bool FONAGeofences::begin(const FONAGeofence* fences, uint16_t count,
+                          uint8_t grid, uint16_t* buffer, uint32_t buflen) {
+  uint32_t ncells = (uint32_t)grid * grid;
+  uint32_t need = bufferSize(fences, count, grid);
+  if (!need || (need > buflen) ||
+      (need - ncells - 1 - (count + 15) / 16 > 0xFFFF))
+    return false;
+
+  _fences = fences;
+  _count = count;
+  _grid = grid;
+  gridLayout(fences, count, grid, &_min, &_cellh, &_cellw);
+  _cells = buffer;
+  _entries = buffer + ncells + 1;
+
+  // count the fences of each cell, one place up
+  memset(_cells, 0, (ncells + 1) * sizeof(uint16_t));
+  uint8_t rows[2], cols[2];
+  for (uint16_t f = 0; f < count; f++) {
+    fenceCells(&fences[f], &_min, _cellh, _cellw, rows, cols);
+    for (uint16_t r = rows[0]; r <= rows[1]; r++)
+      for (uint16_t c = cols[0]; c <= cols[1]; c++)
+        _cells[r * grid + c + 1]++;
+  }
+
+  // turn the counts into the start of each cell's list
+  for (uint32_t i = 0; i < ncells; i++)
+    _cells[i + 1] += _cells[i];
+
+  // fill the lists, using each start as a cursor that ends at the next one
+  for (uint16_t f = 0; f < count; f++) {
+    fenceCells(&fences[f], &_min, _cellh, _cellw, rows, cols);
+    for (uint16_t r = rows[0]; r <= rows[1]; r++)
+      for (uint16_t c = cols[0]; c <= cols[1]; c++)
+        _entries[_cells[r * grid + c]++] = f;
+  }
+  for (uint32_t i = ncells; i > 0; i--)
+    _cells[i] = _cells[i - 1];
+  _cells[0] = 0;
+
+  _state = _entries + _cells[ncells];
+  memset(_state, 0, ((count + 15) / 16) * sizeof(uint16_t));
+  _lastcell = -1;
+  return true;
+}
+
+/**
+ * @brief Set the function called on each enter and exit
+ *
+ * @param callback The function, or 0 for none
+ * @param context Passed to the callback
+ */
+void FONAGeofences::setCallback(FONAGeofenceCallback callback,
+                                void* context) {
+  _callback = callback;
+  _context = context;
+}
+
+/**
+ * @brief Test a fix against the fences near it. Fences the previous fix was
+ * inside are tested too, so leaving them is reported.
+ *
+ * @param lat_udeg Latitude in microdegrees
+ * @param lon_udeg Longitude in microdegrees
+ * @return uint16_t The number of enter and exit events
+ */
+uint16_t FONAGeofences::update(int32_t lat_udeg, int32_t lon_udeg) {
+  if (!_count)
+    return 0;
+
+  uint16_t events = 0;
+  int32_t cell = cellOf(lat_udeg, lon_udeg);
+
+  if ((_lastcell >= 0) && (_lastcell != cell)) {
+    for (uint16_t i = _cells[_lastcell]; i < _cells[_lastcell + 1]; i++) {
+      if (inside(_entries[i]))
+        events += check(_entries[i], lat_udeg, lon_udeg);
+    }
+  }
+  if (cell >= 0) {
+    for (uint16_t i = _cells[cell]; i < _cells[cell + 1]; i++)
+      events += check(_entries[i], lat_udeg, lon_udeg);
+  }
+
+  _lastcell = cell;
+  return events;
+}
+
+/**
+ * @brief Check whether the last fix was inside a fence
+ *
+ * @param fence The fence number, its position in the array given to begin()
+ * @return true: inside, false: outside
+ */
+bool FONAGeofences::inside(uint16_t fence) {
+  if (fence >= _count)
+    return false;
+  return _state[fence / 16] & (1U << (fence % 16));
+}
+
+/**
+ * @brief Check whether a fence contains a position
+ *
+ * @param fence The fence
+ * @param lat_udeg Latitude in microdegrees
+ * @param lon_udeg Longitude in microdegrees
+ * @return true: inside, false: outside
+ */
+bool FONAGeofences::contains(const FONAGeofence* fence, int32_t lat_udeg,
+                             int32_t lon_udeg) {
+  if (fence->type == FONA_FENCE_CIRCLE) {
+    float dy = (lat_udeg - fence->center.lat_udeg) * FONA_FENCE_M_PER_UDEG;
+    float dx = (lon_udeg - fence->center.lon_udeg) *
+               lonScale(fence->center.lat_udeg);
+    float r = fence->radius_m;
+    return (dx * dx + dy * dy) <= r * r;
+  }
+
+  if (fence->count < 3)
+    return false;
+
+  // count the edges crossing the ray east of the position
+  const FONAGeoPoint* v = fence->vertices;
+  bool in = false;
+  for (uint16_t i = 0, j = fence->count - 1; i < fence->count; j = i++) {
+    int32_t yi = v[i].lat_udeg;
+    int32_t yj = v[j].lat_udeg;
+    if ((yi > lat_udeg) == (yj > lat_udeg))
+      continue;
+
+    // the crossing is east if lon - xi < (lat - yi) * (xj - xi) / (yj - yi)
+    int64_t lhs = (int64_t)(lon_udeg - v[i].lon_udeg) * (yj - yi);
+    int64_t rhs = (int64_t)(lat_udeg - yi) * (v[j].lon_udeg - v[i].lon_udeg);
+    if ((yj > yi) ? (lhs < rhs) : (lhs > rhs))
+      in = !in;
+  }
+  return in;
+}
+
+/**
+ * @brief Get the grid cell of a position
+ *
+ * @param lat_udeg Latitude in microdegrees
+ * @param lon_udeg Longitude in microdegrees
+ * @return int32_t The cell, -1 if the position is outside the grid
+ */
+int32_t FONAGeofences::cellOf(int32_t lat_udeg, int32_t lon_udeg) {
+  if ((lat_udeg < _min.lat_udeg) || (lon_udeg < _min.lon_udeg))
+    return -1;
+
+  int32_t row = (lat_udeg - _min.lat_udeg) / _cellh;
+  int32_t col = (lon_udeg - _min.lon_udeg) / _cellw;
+  if ((row >= _grid) || (col >= _grid))
+    return -1;
+  return row * _grid + col;
+}
+
+/**
+ * @brief Test a fence and report a change
+ *
+ * @param fence The fence number
+ * @param lat_udeg Latitude in microdegrees
+ * @param lon_udeg Longitude in microdegrees
+ * @return uint16_t 1 if the position entered or left the fence, else 0
+ */
+uint16_t FONAGeofences::check(uint16_t fence, int32_t lat_udeg,
+                              int32_t lon_udeg) {
+  bool in = contains(&_fences[fence], lat_udeg, lon_udeg);
+  if (in == inside(fence))
+    return 0;
+
+  _state[fence / 16] ^= 1U << (fence % 16);
+  if (_callback)
+    _callback(&_fences[fence], in, _context);
+  return 1;
+}
@@ -0,0 +1,78 @@
+/*!
+ * @file FONAGeofence.h
+ *
+ * Geofencing over many polygons and circles. A grid over the fences'
+ * bounding boxes is built once, so each fix is only tested against the
+ * fences whose box covers its cell, and enter/exit events are reported
+ * through a callback.
+ *
+ * BSD license, all text above must be included in any redistribution
+ */
+#ifndef FONA_GEOFENCE_H
+#define FONA_GEOFENCE_H
+
+#include "Adafruit_FONA.h"
+
+// Fence shapes
+#define FONA_FENCE_CIRCLE 0
+#define FONA_FENCE_POLYGON 1
+
+/** A position in microdegrees */
+typedef struct {
+  int32_t lat_udeg; ///< Latitude, north positive
+  int32_t lon_udeg; ///< Longitude, east positive
+} FONAGeoPoint;
+
+/** One fence. The caller keeps the fences and their vertices. */
+typedef struct {
+  uint16_t id;                  ///< Caller's id for the fence
+  uint8_t type;                 ///< FONA_FENCE_CIRCLE or FONA_FENCE_POLYGON
+  FONAGeoPoint center;          ///< Centre of a circle
+  uint32_t radius_m;            ///< Radius of a circle in meters
+  const FONAGeoPoint* vertices; ///< Corners of a polygon, in order
+  uint16_t count;               ///< Number of polygon corners
+} FONAGeofence;
+
+/** Receives an event when a fix enters or leaves a fence */
+typedef void (*FONAGeofenceCallback)(const FONAGeofence* fence, bool inside,
+                                     void* context);
+
+/** Grid indexed set of fences. The index is kept in compressed sparse rows
+ * in a buffer supplied by the caller: an offset per cell into one list of
+ * fence numbers, followed by a bit per fence recording whether the last fix
+ * was inside it. Fences must not cross the 180th meridian. */
+class FONAGeofences {
+ public:
+  FONAGeofences(void);
+
+  static uint32_t bufferSize(const FONAGeofence* fences, uint16_t count,
+                             uint8_t grid);
+  bool begin(const FONAGeofence* fences, uint16_t count, uint8_t grid,
+             uint16_t* buffer, uint32_t buflen);
+  void setCallback(FONAGeofenceCallback callback, void* context);
+
+  uint16_t update(int32_t lat_udeg, int32_t lon_udeg);
+  bool inside(uint16_t fence);
+
+  static bool contains(const FONAGeofence* fence, int32_t lat_udeg,
+                       int32_t lon_udeg);
+
+ private:
+  int32_t cellOf(int32_t lat_udeg, int32_t lon_udeg);
+  uint16_t check(uint16_t fence, int32_t lat_udeg, int32_t lon_udeg);
+
+  const FONAGeofence* _fences;
+  uint16_t _count;
+  uint8_t _grid;
+  FONAGeoPoint _min;
+  int32_t _cellh;
+  int32_t _cellw;
+  uint16_t* _cells;
+  uint16_t* _entries;
+  uint16_t* _state;
+  int32_t _lastcell;
+  FONAGeofenceCallback _callback;
+  void* _context;
+};
+
+#endif
@@ -0,0 +1,413 @@
+/*!
+ * @file FONAGnss.cpp
+ *
+ * Incremental NMEA parser for the sentences the module streams after
+ * enableGPSNMEA() (AT+CGNSTST / AT+CGPSOUT), plus the integer coordinate
+ * parsing it shares with the AT+CGNSINF style replies.
+ *
+ * BSD license, all text above must be included in any redistribution
+ */
+
+#include "FONAGnss.h"
+
+// Parser states
+#define FONA_NMEA_IDLE 0
+#define FONA_NMEA_DATA 1
+#define FONA_NMEA_CHECK_HI 2
+#define FONA_NMEA_CHECK_LO 3
+
+// Sentence not recognised yet
+#define FONA_NMEA_UNKNOWN 0xFF
+
+// What each field holds
+#define FONA_NMEA_SKIP 0
+#define FONA_NMEA_TIME 1
+#define FONA_NMEA_DATE 2
+#define FONA_NMEA_LAT 3
+#define FONA_NMEA_NS 4
+#define FONA_NMEA_LON 5
+#define FONA_NMEA_EW 6
+#define FONA_NMEA_QUALITY 7
+#define FONA_NMEA_STATUS 8
+#define FONA_NMEA_SATS 9
+#define FONA_NMEA_HDOP 10
+#define FONA_NMEA_ALT 11
+#define FONA_NMEA_SPEED 12
+#define FONA_NMEA_COURSE 13
+#define FONA_NMEA_MODE 14
+
+// Fields mapped per sentence, counting the sentence name as field 0
+#define FONA_NMEA_FIELDS 17
+
+// Sentence names, in the order of the FONA_NMEA_GGA etc. bits
+static const char nmeanames[] PROGMEM = "GGARMCGSAVTG";
+
+static const uint8_t nmeafields[4][FONA_NMEA_FIELDS] PROGMEM = {
+    // GGA: time, lat, N/S, lon, E/W, quality, satellites, HDOP, altitude
+    {FONA_NMEA_SKIP, FONA_NMEA_TIME, FONA_NMEA_LAT, FONA_NMEA_NS,
+     FONA_NMEA_LON, FONA_NMEA_EW, FONA_NMEA_QUALITY, FONA_NMEA_SATS,
+     FONA_NMEA_HDOP, FONA_NMEA_ALT},
+    // RMC: time, status, lat, N/S, lon, E/W, speed, course, date
+    {FONA_NMEA_SKIP, FONA_NMEA_TIME, FONA_NMEA_STATUS, FONA_NMEA_LAT,
+     FONA_NMEA_NS, FONA_NMEA_LON, FONA_NMEA_EW, FONA_NMEA_SPEED,
+     FONA_NMEA_COURSE, FONA_NMEA_DATE},
+    // GSA: selection, fix mode, 12 satellite ids, PDOP, HDOP
+    {FONA_NMEA_SKIP, FONA_NMEA_SKIP, FONA_NMEA_MODE, FONA_NMEA_SKIP,
+     FONA_NMEA_SKIP, FONA_NMEA_SKIP, FONA_NMEA_SKIP, FONA_NMEA_SKIP,
+     FONA_NMEA_SKIP, FONA_NMEA_SKIP, FONA_NMEA_SKIP, FONA_NMEA_SKIP,
+     FONA_NMEA_SKIP, FONA_NMEA_SKIP, FONA_NMEA_SKIP, FONA_NMEA_SKIP,
+     FONA_NMEA_HDOP},
+    // VTG: true course, T, magnetic course, M, speed in knots
+    {FONA_NMEA_SKIP, FONA_NMEA_COURSE, FONA_NMEA_SKIP, FONA_NMEA_SKIP,
+     FONA_NMEA_SKIP, FONA_NMEA_SPEED},
+};
+
+/**
+ * @brief Parse two decimal digits
+ *
+ * @param s The digits
+ * @return uint8_t Their value
+ */
+static uint8_t twoDigits(const char* s) {
+  return (s[0] - '0') * 10 + (s[1] - '0');
+}
+
+/**
+ * @brief Get the value of a hex digit
+ *
+ * @param c The digit
+ * @return int8_t Its value, -1 if c is not a hex digit
+ */
+static int8_t hexValue(char c) {
+  if ((c >= '0') && (c <= '9'))
+    return c - '0';
+  if ((c >= 'A') && (c <= 'F'))
+    return c - 'A' + 10;
+  if ((c >= 'a') && (c <= 'f'))
+    return c - 'a' + 10;
+  return -1;
+}
+
+/**
+ * @brief Construct a new FONANMEAParser object
+ *
+ */
+FONANMEAParser::FONANMEAParser(void) {
+  reset();
+  _errors = 0;
+}
+
+/**
+ * @brief Forget the fix and any partial sentence
+ *
+ */
+void FONANMEAParser::reset(void) {
+  memset(&_fix, 0, sizeof(_fix));
+  _fix.mode = FONA_GNSS_FIX_NONE;
+  _state = FONA_NMEA_IDLE;
+  _updated = 0;
+}
+
+/**
+ * @brief Parse one byte of the NMEA stream
+ *
+ * @param c The byte
+ * @return uint8_t The FONA_NMEA_GGA etc. bit of a sentence that this byte
+ * completed and that updated the fix, 0 otherwise
+ */
+uint8_t FONANMEAParser::feed(char c) {
+  if (c == '$') {
+    _next = _fix;
+    _sum = 0;
+    _index = 0;
+    _fieldlen = 0;
+    _sentence = FONA_NMEA_UNKNOWN;
+    _state = FONA_NMEA_DATA;
+    return 0;
+  }
+
+  switch (_state) {
+    case FONA_NMEA_DATA:
+      if (c == '*') {
+        field();
+        if (_state == FONA_NMEA_DATA)
+          _state = FONA_NMEA_CHECK_HI;
+      } else if ((c == '\r') || (c == '\n')) {
+        // no checksum, so the fields can't be trusted
+        _state = FONA_NMEA_IDLE;
+      } else if (c == ',') {
+        _sum ^= c;
+        field();
+        _index++;
+        _fieldlen = 0;
+      } else if (_fieldlen < sizeof(_field) - 1) {
+        _sum ^= c;
+        _field[_fieldlen++] = c;
+      } else {
+        _state = FONA_NMEA_IDLE;
+      }
+      return 0;
+
+    case FONA_NMEA_CHECK_HI:
+    case FONA_NMEA_CHECK_LO: {
+      int8_t v = hexValue(c);
+      if (v < 0) {
+        _errors++;
+        _state = FONA_NMEA_IDLE;
+        return 0;
+      }
+      if (_state == FONA_NMEA_CHECK_HI) {
+        _check = v << 4;
+        _state = FONA_NMEA_CHECK_LO;
+        return 0;
+      }
+
+      _state = FONA_NMEA_IDLE;
+      if ((_check | v) != _sum) {
+        _errors++;
+        return 0;
+      }
+      _fix = _next;
+      _updated |= 1 << _sentence;
+      return 1 << _sentence;
+    }
+
+    default:
+      return 0;
+  }
+}
+
+/**
+ * @brief Parse everything waiting on a stream, e.g. the FONA itself once
+ * enableGPSNMEA() is on
+ *
+ * @param in The stream to read
+ * @return uint8_t The FONA_NMEA_GGA etc. bits of the sentences that updated
+ * the fix
+ */
+uint8_t FONANMEAParser::feed(FONAStreamType& in) {
+  uint8_t got = 0;
+  while (in.available())
+    got |= feed((char)in.read());
+  return got;
+}
+
+/**
+ * @brief Get the fix built from the sentences parsed so far
+ *
+ * @return const FONAGnssFix* The fix
+ */
+const FONAGnssFix* FONANMEAParser::fix(void) {
+  return &_fix;
+}
+
+/**
+ * @brief Get the sentences that updated the fix since the last call, e.g.
+ * to wait for both GGA and RMC of one epoch
+ *
+ * @return uint8_t FONA_NMEA_GGA etc. bits
+ */
+uint8_t FONANMEAParser::updated(void) {
+  uint8_t u = _updated;
+  _updated = 0;
+  return u;
+}
+
+/**
+ * @brief Get the number of sentences dropped for a bad checksum
+ *
+ * @return uint16_t The number of errors
+ */
+uint16_t FONANMEAParser::errors(void) {
+  return _errors;
+}
+
+/**
+ * @brief Store the field just read in the pending fix, according to the
+ * table for the current sentence
+ *
+ */
+void FONANMEAParser::field(void) {
+  _field[_fieldlen] = 0;
+
+  if (_index == 0) {
+    // "GPGGA", "GNRMC" etc: match on the sentence, not the talker
+    if (_fieldlen == 5) {
+      for (uint8_t i = 0; i < 4; i++) {
+        uint8_t j = 0;
+        while ((j < 3) &&
+               (_field[2 + j] == (char)pgm_read_byte(&nmeanames[i * 3 + j])))
+          j++;
+        if (j == 3)
+          _sentence = i;
+      }
+    }
+    if (_sentence == FONA_NMEA_UNKNOWN)
+      _state = FONA_NMEA_IDLE;
+    return;
+  }
+
+  if (_index >= FONA_NMEA_FIELDS)
+    return;
+
+  int32_t v;
+  switch (pgm_read_byte(&nmeafields[_sentence][_index])) {
+    case FONA_NMEA_TIME:
+      if (_fieldlen >= 6) {
+        _next.hour = twoDigits(_field);
+        _next.minute = twoDigits(_field + 2);
+        _next.second = twoDigits(_field + 4);
+      }
+      break;
+
+    case FONA_NMEA_DATE:
+      if (_fieldlen == 6) {
+        _next.day = twoDigits(_field);
+        _next.month = twoDigits(_field + 2);
+        _next.year = twoDigits(_field + 4);
+      }
+      break;
+
+    case FONA_NMEA_LAT:
+      FONAparseNMEACoord(_field, 'N', &_next.lat_udeg);
+      break;
+
+    case FONA_NMEA_NS:
+      if ((_field[0] == 'S') && (_next.lat_udeg > 0))
+        _next.lat_udeg = -_next.lat_udeg;
+      break;
+
+    case FONA_NMEA_LON:
+      FONAparseNMEACoord(_field, 'E', &_next.lon_udeg);
+      break;
+
+    case FONA_NMEA_EW:
+      if ((_field[0] == 'W') && (_next.lon_udeg > 0))
+        _next.lon_udeg = -_next.lon_udeg;
+      break;
+
+    case FONA_NMEA_QUALITY:
+      if (_fieldlen)
+        _next.valid = (_field[0] != '0');
+      break;
+
+    case FONA_NMEA_STATUS:
+      if (_fieldlen)
+        _next.valid = (_field[0] == 'A');
+      break;
+
+    case FONA_NMEA_SATS:
+      if (_fieldlen)
+        _next.sats = atoi(_field);
+      break;
+
+    case FONA_NMEA_HDOP:
+      if (FONAparseFixed(_field, 2, &v))
+        _next.hdop = v;
+      break;
+
+    case FONA_NMEA_ALT:
+      if (FONAparseFixed(_field, 2, &v))
+        _next.alt_cm = v;
+      break;
+
+    case FONA_NMEA_SPEED:
+      // thousandths of a knot to cm/s: 1 knot is 1852 m/h
+      if (FONAparseFixed(_field, 3, &v)) {
+        uint32_t cmps = ((uint32_t)v * 1852 + 18000) / 36000;
+        _next.speed_cmps = (cmps > 0xFFFF) ? 0xFFFF : cmps;
+      }
+      break;
+
+    case FONA_NMEA_COURSE:
+      if (FONAparseFixed(_field, 2, &v))
+        _next.course_cdeg = v;
+      break;
+
+    case FONA_NMEA_MODE:
+      if ((_field[0] >= '1') && (_field[0] <= '3'))
+        _next.mode = _field[0] - '0';
+      break;
+  }
+}
+
+/********* NUMBERS ******************************************************/
+
+/**
+ * @brief Parse a decimal number into a scaled integer without floating
+ * point, e.g. "-12.345" with 2 decimals gives -1235. Digits beyond the
+ * requested decimals are rounded off.
+ *
+ * @param s The number, ending at any character that is not part of it
+ * @param decimals The number of decimals to keep
+ * @param v Set to the number times 10^decimals
+ * @return true: success, false: there were no digits
+ */
+bool FONAparseFixed(const char* s, uint8_t decimals, int32_t* v) {
+  bool negative = (*s == '-');
+  if ((*s == '-') || (*s == '+'))
+    s++;
+
+  int32_t r = 0;
+  bool digits = false;
+  while ((*s >= '0') && (*s <= '9')) {
+    r = r * 10 + (*s++ - '0');
+    digits = true;
+  }
+
+  if (*s == '.') {
+    bool roundup = false;
+    bool dropped = false;
+    for (s++; (*s >= '0') && (*s <= '9'); s++) {
+      if (decimals) {
+        r = r * 10 + (*s - '0');
+        decimals--;
+      } else if (!dropped) {
+        // round on the first digit that doesn't fit
+        roundup = (*s >= '5');
+        dropped = true;
+      }
+      digits = true;
+    }
+    if (roundup)
+      r++;
+  }
+  if (!digits)
+    return false;
+
+  while (decimals--)
+    r *= 10;
+
+  *v = negative ? -r : r;
+  return true;
+}
+
+/**
+ * @brief Parse an NMEA ddmm.mmmm or dddmm.mmmm coordinate into
+ * microdegrees without floating point
+ *
+ * @param s The coordinate
+ * @param hemisphere 'N', 'S', 'E' or 'W'; south and west are negative
+ * @param udeg Set to the coordinate in microdegrees
+ * @return true: success, false: the coordinate is empty
+ */
+bool FONAparseNMEACoord(const char* s, char hemisphere, int32_t* udeg) {
+  int32_t whole = 0;
+  bool digits = false;
+  while ((*s >= '0') && (*s <= '9')) {
+    whole = whole * 10 + (*s++ - '0');
+    digits = true;
+  }
+
+  // millionths of a minute
+  int32_t frac = 0;
+  if (*s == '.')
+    digits |= FONAparseFixed(s, 6, &frac);
+  if (!digits)
+    return false;
+
+  int32_t v = (whole / 100) * 1000000L +
+              ((whole % 100) * 1000000L + frac + 30) / 60;
+  *udeg = ((hemisphere == 'S') || (hemisphere == 'W')) ? -v : v;
+  return true;
+}
@@ -0,0 +1,58 @@
+/*!
+ * @file FONAGnss.h
+ *
+ * Incremental NMEA parser for the sentences the module streams after
+ * enableGPSNMEA() (AT+CGNSTST / AT+CGPSOUT), plus the integer coordinate
+ * parsing it shares with the AT+CGNSINF style replies.
+ *
+ * BSD license, all text above must be included in any redistribution
+ */
+#ifndef FONA_GNSS_H
+#define FONA_GNSS_H
+
+#include "Adafruit_FONA.h"
+
+// Sentences returned by FONANMEAParser::feed() and updated()
+#define FONA_NMEA_GGA 0x01
+#define FONA_NMEA_RMC 0x02
+#define FONA_NMEA_GSA 0x04
+#define FONA_NMEA_VTG 0x08
+
+// Longest NMEA field kept while parsing; longer fields drop the sentence
+#define FONA_NMEA_FIELD_LEN 16
+
+/** Byte at a time NMEA 0183 parser for GGA, RMC, GSA and VTG sentences
+ * from any talker. Fields only reach the fix once the sentence checksum has
+ * been verified. */
+class FONANMEAParser {
+ public:
+  FONANMEAParser(void);
+
+  void reset(void);
+  uint8_t feed(char c);
+  uint8_t feed(FONAStreamType& in);
+
+  const FONAGnssFix* fix(void);
+  uint8_t updated(void);
+  uint16_t errors(void);
+
+ private:
+  void field(void);
+
+  FONAGnssFix _fix;
+  FONAGnssFix _next;
+  char _field[FONA_NMEA_FIELD_LEN];
+  uint8_t _fieldlen;
+  uint8_t _index;
+  uint8_t _sentence;
+  uint8_t _state;
+  uint8_t _sum;
+  uint8_t _check;
+  uint8_t _updated;
+  uint16_t _errors;
+};
+
+bool FONAparseFixed(const char* s, uint8_t decimals, int32_t* v);
+bool FONAparseNMEACoord(const char* s, char hemisphere, int32_t* udeg);
+
+#endif
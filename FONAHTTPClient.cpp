@@ -0,0 +1,524 @@
+/*!
+ * @file FONAHTTPClient.cpp
+ *
+ * HTTP/1.1 client on top of the Adafruit_FONA raw TCP functions. Unlike
+ * AT+HTTPACTION it keeps the connection open between requests and can
+ * pipeline several requests before reading the responses.
+ *
+ * BSD license, all text above must be included in any redistribution
+ */
+
+#include "FONAHTTPClient.h"
+
+// Parser states
+#define FONA_HTTP_STATUS 0
+#define FONA_HTTP_HEADER 1
+#define FONA_HTTP_BODY 2
+#define FONA_HTTP_BODY_CLOSE 3
+#define FONA_HTTP_CHUNK_SIZE 4
+#define FONA_HTTP_CHUNK_DATA 5
+#define FONA_HTTP_CHUNK_END 6
+#define FONA_HTTP_TRAILER 7
+#define FONA_HTTP_DONE 8
+#define FONA_HTTP_ERROR 9
+
+// Most requests that can wait for a response at once
+#define FONA_HTTP_MAX_PIPELINE 8
+
+/********* TCP WRITER ***************************************************/
+
+/**
+ * @brief Construct a new FONATCPWriter object
+ *
+ * @param fona The module whose TCP connection to write to
+ */
+FONATCPWriter::FONATCPWriter(Adafruit_FONA& fona) {
+  _fona = &fona;
+  _len = 0;
+  _failed = false;
+}
+
+/**
+ * @brief Queue a byte, sending the buffer once it is full
+ *
+ * @param c The byte to write
+ * @return size_t 1 if the byte was queued, 0 after a failed send
+ */
+size_t FONATCPWriter::write(uint8_t c) {
+  if (_failed)
+    return 0;
+
+  _buffer[_len++] = c;
+  if ((_len == sizeof(_buffer)) && !send())
+    return 0;
+  return 1;
+}
+
+/**
+ * @brief Send whatever is buffered
+ *
+ * @return true: success, false: this or an earlier send failed
+ */
+bool FONATCPWriter::send(void) {
+  if (_len && !_failed)
+    _failed = !_fona->TCPsend(_buffer, _len);
+  _len = 0;
+  return !_failed;
+}
+
+/**
+ * @brief Check whether a send failed since the last reset()
+ *
+ * @return true: a send failed, false: all sends succeeded
+ */
+bool FONATCPWriter::failed(void) {
+  return _failed;
+}
+
+/**
+ * @brief Drop buffered data and clear the failure flag
+ *
+ */
+void FONATCPWriter::reset(void) {
+  _len = 0;
+  _failed = false;
+}
+
+/********* RESPONSE PARSER **********************************************/
+
+/**
+ * @brief Construct a new FONAHTTPResponseParser object
+ *
+ */
+FONAHTTPResponseParser::FONAHTTPResponseParser(void) {
+  begin(0, 0);
+}
+
+/**
+ * @brief Get ready to parse a new response
+ *
+ * @param callback Function called with each chunk of the body, may be 0
+ * @param context Pointer passed through to the callback
+ * @param head true if the response answers a HEAD request and has no body
+ */
+void FONAHTTPResponseParser::begin(FONAHTTPReadCallback callback,
+                                   void* context, bool head) {
+  _callback = callback;
+  _context = context;
+  _state = FONA_HTTP_STATUS;
+  _head = head;
+  _chunked = false;
+  _haslength = false;
+  _keepalive = true;
+  _status = 0;
+  _remaining = 0;
+  _offset = 0;
+  _linelen = 0;
+}
+
+/**
+ * @brief Parse received bytes
+ *
+ * @param data Pointer to the received bytes
+ * @param len The number of bytes
+ * @return uint16_t The number of bytes used. Less than len once the response
+ * is complete; the rest belongs to the next response.
+ */
+uint16_t FONAHTTPResponseParser::feed(const uint8_t* data, uint16_t len) {
+  uint16_t i = 0;
+
+  while ((i < len) && (_state != FONA_HTTP_DONE) &&
+         (_state != FONA_HTTP_ERROR)) {
+    if ((_state == FONA_HTTP_BODY) || (_state == FONA_HTTP_CHUNK_DATA) ||
+        (_state == FONA_HTTP_BODY_CLOSE)) {
+      uint16_t n = len - i;
+      if ((_state != FONA_HTTP_BODY_CLOSE) && (_remaining < n))
+        n = _remaining;
+
+      if (!body(data + i, n)) {
+        _state = FONA_HTTP_ERROR;
+        break;
+      }
+      i += n;
+
+      if (_state == FONA_HTTP_BODY_CLOSE)
+        continue;
+      _remaining -= n;
+      if (_remaining == 0)
+        _state = (_state == FONA_HTTP_BODY) ? FONA_HTTP_DONE
+                                            : FONA_HTTP_CHUNK_END;
+      continue;
+    }
+
+    // everything else is line oriented
+    char c = data[i++];
+    if (c == '\n') {
+      _line[_linelen] = 0;
+      line();
+      _linelen = 0;
+    } else if ((c != '\r') && (_linelen < sizeof(_line) - 1)) {
+      _line[_linelen++] = c;
+    }
+  }
+
+  return i;
+}
+
+/**
+ * @brief Tell the parser the connection closed, which ends a body that has
+ * neither a length nor chunked encoding
+ *
+ */
+void FONAHTTPResponseParser::finish(void) {
+  if (_state == FONA_HTTP_BODY_CLOSE)
+    _state = FONA_HTTP_DONE;
+  else if (_state != FONA_HTTP_DONE)
+    _state = FONA_HTTP_ERROR;
+}
+
+/**
+ * @brief Check whether the response is complete
+ *
+ * @return true: complete, false: more data needed or failed
+ */
+bool FONAHTTPResponseParser::done(void) {
+  return _state == FONA_HTTP_DONE;
+}
+
+/**
+ * @brief Check whether the response was malformed, cut short or stopped by
+ * the callback
+ *
+ * @return true: failed, false: ok so far
+ */
+bool FONAHTTPResponseParser::failed(void) {
+  return _state == FONA_HTTP_ERROR;
+}
+
+/**
+ * @brief Get the response status code
+ *
+ * @return uint16_t The status code, 0 until the status line was parsed
+ */
+uint16_t FONAHTTPResponseParser::status(void) {
+  return _status;
+}
+
+/**
+ * @brief Check whether the server keeps the connection open
+ *
+ * @return true: the connection can be reused, false: the server closes it
+ */
+bool FONAHTTPResponseParser::keepAlive(void) {
+  return _keepalive;
+}
+
+/**
+ * @brief Get the number of body bytes passed to the callback so far
+ *
+ * @return uint32_t The body length
+ */
+uint32_t FONAHTTPResponseParser::bodyLength(void) {
+  return _offset;
+}
+
+/**
+ * @brief Handle one complete line (without CR LF) in _line
+ *
+ */
+void FONAHTTPResponseParser::line(void) {
+  switch (_state) {
+    case FONA_HTTP_STATUS:
+      // HTTP/1.1 200 OK
+      if (strncmp(_line, "HTTP/1.", 7) != 0) {
+        if (_linelen)
+          _state = FONA_HTTP_ERROR;
+        return;
+      }
+      if (_line[7] == '0')
+        _keepalive = false;
+      _status = atoi(_line + 9);
+      _state = FONA_HTTP_HEADER;
+      return;
+
+    case FONA_HTTP_HEADER:
+      if (_linelen == 0) {
+        headersDone();
+      } else if (prog_char_strncasecmp(_line, (prog_char*)F("Content-Length:"),
+                                       15) == 0) {
+        _remaining = strtoul(_line + 15, NULL, 10);
+        _haslength = true;
+      } else if (prog_char_strncasecmp(
+                     _line, (prog_char*)F("Transfer-Encoding:"), 18) == 0) {
+        _chunked = (strstr(_line + 18, "chunked") != 0);
+      } else if (prog_char_strncasecmp(_line, (prog_char*)F("Connection:"),
+                                       11) == 0) {
+        if (strstr(_line + 11, "close") || strstr(_line + 11, "Close"))
+          _keepalive = false;
+        else if (strstr(_line + 11, "eep-"))
+          _keepalive = true;
+      }
+      return;
+
+    case FONA_HTTP_CHUNK_SIZE:
+      // hex size, possibly followed by ;extensions
+      _remaining = strtoul(_line, NULL, 16);
+      _state = _remaining ? FONA_HTTP_CHUNK_DATA : FONA_HTTP_TRAILER;
+      return;
+
+    case FONA_HTTP_CHUNK_END:
+      _state = FONA_HTTP_CHUNK_SIZE;
+      return;
+
+    case FONA_HTTP_TRAILER:
+      if (_linelen == 0)
+        _state = FONA_HTTP_DONE;
+      return;
+  }
+}
+
+/**
+ * @brief Work out how the body is delimited once the headers are read
+ *
+ */
+void FONAHTTPResponseParser::headersDone(void) {
+  if (_status == 100) {
+    // 100 Continue, the real response follows
+    begin(_callback, _context, _head);
+    return;
+  }
+
+  if (_head || (_status < 200) || (_status == 204) || (_status == 304))
+    _state = FONA_HTTP_DONE;
+  else if (_chunked)
+    _state = FONA_HTTP_CHUNK_SIZE;
+  else if (_haslength)
+    _state = _remaining ? FONA_HTTP_BODY : FONA_HTTP_DONE;
+  else {
+    _state = FONA_HTTP_BODY_CLOSE;
+    _keepalive = false;
+  }
+}
+
+/**
+ * @brief Pass body bytes on to the callback
+ *
+ * @param data Pointer to the bytes
+ * @param len The number of bytes
+ * @return true: continue, false: the callback asked to stop
+ */
+bool FONAHTTPResponseParser::body(const uint8_t* data, uint16_t len) {
+  bool ok = true;
+  if (_callback && len)
+    ok = _callback(data, len, _offset, _context);
+  _offset += len;
+  return ok;
+}
+
+/********* CLIENT *******************************************************/
+
+/**
+ * @brief Construct a new FONAHTTPClient object
+ *
+ * @param fona The module to connect with
+ */
+FONAHTTPClient::FONAHTTPClient(Adafruit_FONA& fona) : _writer(fona) {
+  _fona = &fona;
+  _host = 0;
+  _port = 0;
+  _connected = false;
+  _pending = 0;
+  _pendinghead = 0;
+  _rxpos = 0;
+  _rxlen = 0;
+}
+
+/**
+ * @brief Connect to a server, reusing the open connection when it already
+ * goes to the same host and port
+ *
+ * @param host Pointer to a buffer with the host name, also sent as the Host
+ * header. Must stay valid while the client is used.
+ * @param port The port to connect to
+ * @return true: success, false: failure
+ */
+bool FONAHTTPClient::connect(char* host, uint16_t port) {
+  if (_connected && (_host == host || strcmp(_host, host) == 0) &&
+      (_port == port) && _fona->TCPconnected())
+    return true;
+
+  close();
+  _host = host;
+  _port = port;
+  _connected = _fona->TCPconnect(host, port);
+  return _connected;
+}
+
+/**
+ * @brief Close the connection, dropping any responses not read yet
+ *
+ */
+void FONAHTTPClient::close(void) {
+  if (_connected)
+    _fona->TCPclose();
+  _connected = false;
+  _pending = 0;
+  _pendinghead = 0;
+  _rxpos = 0;
+  _rxlen = 0;
+  _writer.reset();
+}
+
+/**
+ * @brief Check whether the connection is believed to be open
+ *
+ * @return true: open, false: closed
+ */
+bool FONAHTTPClient::connected(void) {
+  return _connected;
+}
+
+/**
+ * @brief Queue a request on the connection. Requests are only sent once the
+ * write buffer fills or readResponse() is called, so a burst of small
+ * requests shares CIPSEND round trips. Reconnects if the server closed the
+ * connection.
+ *
+ * @param method The request method, e.g. F("GET")
+ * @param path Pointer to a buffer with the path and query
+ * @param contenttype The body content type, 0 for no body
+ * @param body Pointer to the body
+ * @param bodylen The length of the body
+ * @return true: success, false: failure or too many requests in flight
+ */
+bool FONAHTTPClient::sendRequest(FONAFlashStringPtr method, const char* path,
+                                 FONAFlashStringPtr contenttype,
+                                 const uint8_t* body, uint16_t bodylen) {
+  if (_pending >= FONA_HTTP_MAX_PIPELINE)
+    return false;
+  if (!_connected && (!_host || !connect(_host, _port)))
+    return false;
+
+  _writer.print(method);
+  _writer.print(' ');
+  _writer.print(path);
+  _writer.print(F(" HTTP/1.1\r\nHost: "));
+  _writer.print(_host);
+  _writer.print(F("\r\nConnection: keep-alive\r\n"));
+  if (contenttype) {
+    _writer.print(F("Content-Type: "));
+    _writer.print(contenttype);
+    _writer.print(F("\r\nContent-Length: "));
+    _writer.print(bodylen);
+    _writer.print(F("\r\n"));
+  }
+  _writer.print(F("\r\n"));
+  if (bodylen)
+    _writer.write(body, bodylen);
+
+  if (_writer.failed()) {
+    close();
+    return false;
+  }
+
+  if (prog_char_strcmp("HEAD", (prog_char*)method) == 0)
+    _pendinghead |= (1 << _pending);
+  _pending++;
+  return true;
+}
+
+/**
+ * @brief Queue a GET request
+ *
+ * @param path Pointer to a buffer with the path and query
+ * @return true: success, false: failure
+ */
+bool FONAHTTPClient::get(const char* path) {
+  return sendRequest(F("GET"), path);
+}
+
+/**
+ * @brief Queue a POST request
+ *
+ * @param path Pointer to a buffer with the path and query
+ * @param contenttype The body content type
+ * @param body Pointer to the body
+ * @param bodylen The length of the body
+ * @return true: success, false: failure
+ */
+bool FONAHTTPClient::post(const char* path, FONAFlashStringPtr contenttype,
+                          const uint8_t* body, uint16_t bodylen) {
+  return sendRequest(F("POST"), path, contenttype, body, bodylen);
+}
+
+/**
+ * @brief Read the response to the oldest queued request
+ *
+ * @param status Pointer to a uint16_t to hold the response status
+ * @param callback Function called with each chunk of the body, may be 0 to
+ * discard it
+ * @param context Pointer passed through to the callback
+ * @param timeout Give up after this many milliseconds without data
+ * @return true: a complete response was read, false: failure
+ */
+bool FONAHTTPClient::readResponse(uint16_t* status,
+                                  FONAHTTPReadCallback callback,
+                                  void* context, uint16_t timeout) {
+  if (!_pending)
+    return false;
+
+  if (!_writer.send()) {
+    close();
+    return false;
+  }
+
+  _parser.begin(callback, context, _pendinghead & 1);
+  _pending--;
+  _pendinghead >>= 1;
+
+  uint32_t start = millis();
+  while (!_parser.done() && !_parser.failed()) {
+    if (_rxpos < _rxlen) {
+      _rxpos += _parser.feed(_rx + _rxpos, _rxlen - _rxpos);
+      continue;
+    }
+
+    uint16_t avail = _fona->TCPavailable();
+    if (avail) {
+      if (avail > sizeof(_rx))
+        avail = sizeof(_rx);
+      _rxpos = 0;
+      _rxlen = _fona->TCPread(_rx, avail);
+      if (_rxlen)
+        start = millis();
+      continue;
+    }
+
+    if (_fona->pollURC(50, FONA_URC_TCP_CLOSED)) {
+      _connected = false;
+      _parser.finish();
+    } else if ((uint32_t)(millis() - start) >= timeout) {
+      break;
+    }
+  }
+
+  *status = _parser.status();
+  if (!_parser.done()) {
+    close();
+    return false;
+  }
+  if (!_parser.keepAlive()) {
+    // the server closes after this response, anything else queued is lost
+    close();
+  }
+  return true;
+}
+
+/**
+ * @brief Get the number of requests still waiting for readResponse()
+ *
+ * @return uint8_t The number of pending requests
+ */
+uint8_t FONAHTTPClient::pending(void) {
+  return _pending;
+}
@@ -0,0 +1,117 @@
+/*!
+ * @file FONAHTTPClient.h
+ *
+ * HTTP/1.1 client on top of the Adafruit_FONA raw TCP functions. Unlike
+ * AT+HTTPACTION it keeps the connection open between requests and can
+ * pipeline several requests before reading the responses.
+ *
+ * BSD license, all text above must be included in any redistribution
+ */
+#ifndef FONA_HTTP_CLIENT_H
+#define FONA_HTTP_CLIENT_H
+
+#include "Adafruit_FONA.h"
+
+// Bytes collected before each AT+CIPSEND (at most 255)
+#ifndef FONA_TCP_WRITE_BUFFER
+#define FONA_TCP_WRITE_BUFFER 64
+#endif
+
+// Bytes fetched with each AT+CIPRXGET=2 (at most 255)
+#ifndef FONA_TCP_READ_BUFFER
+#define FONA_TCP_READ_BUFFER 64
+#endif
+
+// Longest response line kept while parsing; longer header lines are only
+// matched on their start
+#define FONA_HTTP_LINE_BUFFER 40
+
+/** Print that collects bytes and sends them with TCPsend() when full */
+class FONATCPWriter : public Print {
+ public:
+  FONATCPWriter(Adafruit_FONA& fona);
+
+  size_t write(uint8_t c);
+  using Print::write;
+  bool send(void);
+  bool failed(void);
+  void reset(void);
+
+ private:
+  Adafruit_FONA* _fona;
+  char _buffer[FONA_TCP_WRITE_BUFFER];
+  uint8_t _len;
+  bool _failed;
+};
+
+/** Incremental HTTP/1.x response parser. Handles Content-Length, chunked
+ * and read-until-close bodies and stops at the end of each response, so
+ * pipelined responses can be parsed back to back. */
+class FONAHTTPResponseParser {
+ public:
+  FONAHTTPResponseParser(void);
+
+  void begin(FONAHTTPReadCallback callback, void* context,
+             bool head = false);
+  uint16_t feed(const uint8_t* data, uint16_t len);
+  void finish(void);
+
+  bool done(void);
+  bool failed(void);
+  uint16_t status(void);
+  bool keepAlive(void);
+  uint32_t bodyLength(void);
+
+ private:
+  void line(void);
+  void headersDone(void);
+  bool body(const uint8_t* data, uint16_t len);
+
+  FONAHTTPReadCallback _callback;
+  void* _context;
+  uint8_t _state;
+  bool _head;
+  bool _chunked;
+  bool _haslength;
+  bool _keepalive;
+  uint16_t _status;
+  uint32_t _remaining;
+  uint32_t _offset;
+  char _line[FONA_HTTP_LINE_BUFFER];
+  uint8_t _linelen;
+};
+
+/** Keep-alive, pipelining HTTP/1.1 client over a FONA TCP connection */
+class FONAHTTPClient {
+ public:
+  FONAHTTPClient(Adafruit_FONA& fona);
+
+  bool connect(char* host, uint16_t port = 80);
+  void close(void);
+  bool connected(void);
+
+  bool sendRequest(FONAFlashStringPtr method, const char* path,
+                   FONAFlashStringPtr contenttype = 0,
+                   const uint8_t* body = 0, uint16_t bodylen = 0);
+  bool get(const char* path);
+  bool post(const char* path, FONAFlashStringPtr contenttype,
+            const uint8_t* body, uint16_t bodylen);
+  bool readResponse(uint16_t* status, FONAHTTPReadCallback callback = 0,
+                    void* context = 0, uint16_t timeout = 10000);
+  uint8_t pending(void);
+
+ private:
+  Adafruit_FONA* _fona;
+  FONATCPWriter _writer;
+  FONAHTTPResponseParser _parser;
+  char* _host;
+  uint16_t _port;
+  bool _connected;
+  uint8_t _pending;
+  uint8_t _pendinghead;
+  uint8_t _rx[FONA_TCP_READ_BUFFER];
+  uint8_t _rxpos;
+  uint8_t _rxlen;
+};
+
+#endif
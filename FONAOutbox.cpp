@@ -0,0 +1,362 @@
+/*!
+ * @file FONAOutbox.cpp
+ *
+ * Batched uploader: records are queued in a ring on a FONAStorage and sent
+ * together in one HTTP POST once enough bytes or time have built up, so the
+ * HTTP setup is paid once per batch instead of once per reading.
+ *
+ * BSD license, all text above must be included in any redistribution
+ */
+
+#include "FONAOutbox.h"
+
+// Marks an initialised outbox header
+#define FONA_OUTBOX_MAGIC 0x0B0B
+
+// Length prefix that follows the newest record, also blank EEPROM
+#define FONA_OUTBOX_END 0xFFFF
+
+/** Ring state kept at the start of the storage. It is only rewritten when
+ * records are dropped; records appended since are found again by load(). */
+typedef struct {
+  uint16_t magic;  ///< FONA_OUTBOX_MAGIC
+  uint32_t head;   ///< Ring offset of the oldest record
+  uint32_t used;   ///< Bytes in use when saved, including length prefixes
+  uint16_t count;  ///< Number of records when saved
+  uint16_t check;  ///< Checksum of the fields above
+} FONAOutboxHeader;
+
+/**
+ * @brief Checksum the header fields, so a torn or foreign header is not
+ * trusted
+ *
+ * @param h The header
+ * @return uint16_t The checksum
+ */
+static uint16_t headerCheck(const FONAOutboxHeader* h) {
+  return h->magic ^ (uint16_t)h->head ^ (uint16_t)(h->head >> 16) ^
+         (uint16_t)h->used ^ (uint16_t)(h->used >> 16) ^ h->count ^ 0x5A5A;
+}
+
+/**
+ * @brief Construct a new FONAOutbox object
+ *
+ * @param fona The module to upload with
+ * @param storage Where to keep the queued records
+ */
+FONAOutbox::FONAOutbox(Adafruit_FONA& fona, FONAStorage& storage) {
+  _fona = &fona;
+  _storage = &storage;
+  _url = 0;
+  _contenttype = 0;
+  _capacity = 0;
+  _head = 0;
+  _used = 0;
+  _count = 0;
+  _maxbytes = 1024;
+  _maxage = 300000;
+  _since = 0;
+  _attempt = 0;
+  _due = false;
+  _failed = false;
+  _rdpos = 0;
+  _rdleft = 0;
+}
+
+/**
+ * @brief Load the queued records from the storage. Records kept over a reset
+ * are sent on the first poll().
+ *
+ * @param url Pointer to a buffer with the URL to POST batches to
+ * @param contenttype The content type of the batches
+ * @return true: success, false: the storage is too small
+ */
+bool FONAOutbox::begin(char* url, FONAFlashStringPtr contenttype) {
+  _url = url;
+  _contenttype = contenttype;
+
+  if (_storage->size() <= sizeof(FONAOutboxHeader) + 4)
+    return false;
+  _capacity = _storage->size() - sizeof(FONAOutboxHeader);
+
+  if (!load())
+    clear();
+
+  _since = millis();
+  _due = (_count > 0);
+  _failed = false;
+  return true;
+}
+
+/**
+ * @brief Set when poll() sends a batch
+ *
+ * @param bytes Send once this many bytes are queued
+ * @param maxage Send once the oldest record is this many ms old
+ */
+void FONAOutbox::setThresholds(uint32_t bytes, uint32_t maxage) {
+  _maxbytes = bytes;
+  _maxage = maxage;
+}
+
+/**
+ * @brief Queue a record, dropping the oldest ones if there is no room. The
+ * header is not rewritten, so appending only wears the cells the record
+ * lands on; when room has to be made at least an eighth of the ring is
+ * dropped, so the header is saved once per that much data.
+ *
+ * @param data The record
+ * @param len The length of the record
+ * @return true: success, false: the record is larger than the storage
+ */
+bool FONAOutbox::append(const uint8_t* data, uint16_t len) {
+  // room for the record and the end marker after it
+  uint32_t need = 4UL + len;
+  if (!_capacity || (need > _capacity) || (len == FONA_OUTBOX_END))
+    return false;
+
+  if (_capacity - _used < need) {
+    uint32_t room = _capacity / 8;
+    if (room < need)
+      room = need;
+    while ((_count > 0) && (_capacity - _used < room))
+      dropOldest();
+    save();
+  }
+
+  // the end marker and the data go in before the prefix that links them
+  uint8_t prefix[2] = {(uint8_t)(FONA_OUTBOX_END & 0xFF),
+                       (uint8_t)(FONA_OUTBOX_END >> 8)};
+  ringWrite(_head + _used + 2 + len, prefix, 2);
+  ringWrite(_head + _used + 2, data, len);
+  prefix[0] = (uint8_t)len;
+  prefix[1] = (uint8_t)(len >> 8);
+  ringWrite(_head + _used, prefix, 2);
+
+  if (_count == 0)
+    _since = millis();
+  _used += 2UL + len;
+  _count++;
+  return true;
+}
+
+/**
+ * @brief Send a batch if the size or age threshold is reached. Call it
+ * regularly from loop().
+ *
+ * @return true: a batch was sent, false: nothing due or the upload failed
+ */
+bool FONAOutbox::poll(void) {
+  if (_count == 0)
+    return false;
+
+  uint32_t now = millis();
+  if (_failed && (now - _attempt < FONA_OUTBOX_RETRY))
+    return false;
+  if (!_due && (_used < _maxbytes) && (now - _since < _maxage))
+    return false;
+
+  _attempt = now;
+  _failed = !flush();
+  return !_failed;
+}
+
+/**
+ * @brief Send all queued records in one POST. They are dropped only if the
+ * server answers with a 2xx status.
+ *
+ * @return true: success or nothing queued, false: failure
+ */
+bool FONAOutbox::flush(void) {
+  if (_count == 0)
+    return true;
+
+  uint16_t status;
+  uint32_t datalen;
+  _rdpos = _head;
+  _rdleft = 0;
+
+  bool ok = _fona->HTTP_POST_start(_url, _contenttype, produce, this,
+                                   _used - 2UL * _count, &status, &datalen);
+  _fona->HTTP_POST_end();
+  if (!ok || (status < 200) || (status > 299))
+    return false;
+
+  _head = (_head + _used) % _capacity;
+  _used = 0;
+  _count = 0;
+  _due = false;
+  save();
+  return true;
+}
+
+/**
+ * @brief Drop all queued records
+ *
+ */
+void FONAOutbox::clear(void) {
+  _head = 0;
+  _used = 0;
+  _count = 0;
+  _due = false;
+
+  uint8_t end[2] = {(uint8_t)(FONA_OUTBOX_END & 0xFF),
+                    (uint8_t)(FONA_OUTBOX_END >> 8)};
+  ringWrite(0, end, 2);
+  save();
+}
+
+/**
+ * @brief Get the number of queued records
+ *
+ * @return uint16_t The number of records
+ */
+uint16_t FONAOutbox::count(void) {
+  return _count;
+}
+
+/**
+ * @brief Get the space taken by the queued records
+ *
+ * @return uint32_t The number of bytes, including 2 per record for framing
+ */
+uint32_t FONAOutbox::used(void) {
+  return _used;
+}
+
+/**
+ * @brief Read the ring state from the storage, then follow the length
+ * prefixes past the saved tail to the end marker to find the records
+ * appended since the header was saved
+ *
+ * @return true: a valid header was found, false: the storage is blank or
+ * corrupt
+ */
+bool FONAOutbox::load(void) {
+  FONAOutboxHeader h;
+  if (!_storage->read(0, (uint8_t*)&h, sizeof(h)))
+    return false;
+
+  if ((h.magic != FONA_OUTBOX_MAGIC) || (h.check != headerCheck(&h)) ||
+      (h.head >= _capacity) || (h.used + 2 > _capacity))
+    return false;
+
+  _head = h.head;
+  _used = h.used;
+  _count = h.count;
+
+  while (true) {
+    uint8_t prefix[2];
+    ringRead(_head + _used, prefix, 2);
+    uint16_t len = prefix[0] | (prefix[1] << 8);
+    // a torn prefix keeps the marker's 0xFF high byte, too long to fit
+    if ((len == FONA_OUTBOX_END) || (4UL + len > _capacity - _used))
+      break;
+    _used += 2UL + len;
+    _count++;
+  }
+  return true;
+}
+
+/**
+ * @brief Write the ring state to the storage
+ *
+ */
+void FONAOutbox::save(void) {
+  FONAOutboxHeader h;
+  h.magic = FONA_OUTBOX_MAGIC;
+  h.head = _head;
+  h.used = _used;
+  h.count = _count;
+  h.check = headerCheck(&h);
+  _storage->write(0, (uint8_t*)&h, sizeof(h));
+}
+
+/**
+ * @brief Read from the ring, wrapping at its end
+ *
+ * @param pos Ring offset, may be past the end
+ * @param data Buffer to fill
+ * @param len The number of bytes
+ */
+void FONAOutbox::ringRead(uint32_t pos, uint8_t* data, uint16_t len) {
+  pos %= _capacity;
+  uint16_t first = len;
+  if (_capacity - pos < first)
+    first = _capacity - pos;
+
+  _storage->read(sizeof(FONAOutboxHeader) + pos, data, first);
+  if (first < len)
+    _storage->read(sizeof(FONAOutboxHeader), data + first, len - first);
+}
+
+/**
+ * @brief Write to the ring, wrapping at its end
+ *
+ * @param pos Ring offset, may be past the end
+ * @param data The bytes to write
+ * @param len The number of bytes
+ */
+void FONAOutbox::ringWrite(uint32_t pos, const uint8_t* data, uint16_t len) {
+  pos %= _capacity;
+  uint16_t first = len;
+  if (_capacity - pos < first)
+    first = _capacity - pos;
+
+  _storage->write(sizeof(FONAOutboxHeader) + pos, data, first);
+  if (first < len)
+    _storage->write(sizeof(FONAOutboxHeader), data + first, len - first);
+}
+
+/**
+ * @brief Drop the oldest record
+ *
+ */
+void FONAOutbox::dropOldest(void) {
+  uint8_t prefix[2];
+  ringRead(_head, prefix, 2);
+  uint32_t len = 2UL + (prefix[0] | (prefix[1] << 8));
+
+  _head = (_head + len) % _capacity;
+  _used -= len;
+  _count--;
+}
+
+/**
+ * @brief Producer for HTTP_POST_start() that copies the records out of the
+ * ring, leaving out their length prefixes
+ *
+ * @param data Buffer to fill
+ * @param maxlen Maximum bytes to copy
+ * @param offset Offset within the body (unused, the body is sent in order)
+ * @param context The FONAOutbox
+ * @return uint16_t The number of bytes copied
+ */
+uint16_t FONAOutbox::produce(uint8_t* data, uint16_t maxlen, uint32_t offset,
+                             void* context) {
+  (void)offset;
+  FONAOutbox* box = (FONAOutbox*)context;
+  uint16_t filled = 0;
+
+  while (filled < maxlen) {
+    if (box->_rdleft == 0) {
+      if (box->_rdpos == box->_head + box->_used)
+        break;
+      uint8_t prefix[2];
+      box->ringRead(box->_rdpos, prefix, 2);
+      box->_rdpos += 2;
+      box->_rdleft = prefix[0] | (prefix[1] << 8);
+      continue;
+    }
+
+    uint16_t n = maxlen - filled;
+    if (box->_rdleft < n)
+      n = box->_rdleft;
+    box->ringRead(box->_rdpos, data + filled, n);
+    box->_rdpos += n;
+    box->_rdleft -= n;
+    filled += n;
+  }
+
+  return filled;
+}
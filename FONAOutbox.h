@@ -0,0 +1,66 @@
+/*!
+ * @file FONAOutbox.h
+ *
+ * Batched uploader: records are queued in a ring on a FONAStorage and sent
+ * together in one HTTP POST once enough bytes or time have built up, so the
+ * HTTP setup is paid once per batch instead of once per reading.
+ *
+ * BSD license, all text above must be included in any redistribution
+ */
+#ifndef FONA_OUTBOX_H
+#define FONA_OUTBOX_H
+
+#include "FONAStorage.h"
+
+// Wait after a failed upload before the next attempt, in ms
+#ifndef FONA_OUTBOX_RETRY
+#define FONA_OUTBOX_RETRY 30000
+#endif
+
+/** Persistent ring of records that are uploaded in batches. The body of each
+ * POST is the records back to back, so they should carry their own framing,
+ * e.g. newline terminated CSV lines or CBOR items. When the ring is full the
+ * oldest records are dropped to make room. */
+class FONAOutbox {
+ public:
+  FONAOutbox(Adafruit_FONA& fona, FONAStorage& storage);
+
+  bool begin(char* url, FONAFlashStringPtr contenttype);
+  void setThresholds(uint32_t bytes, uint32_t maxage);
+
+  bool append(const uint8_t* data, uint16_t len);
+  bool poll(void);
+  bool flush(void);
+  void clear(void);
+
+  uint16_t count(void);
+  uint32_t used(void);
+
+ private:
+  bool load(void);
+  void save(void);
+  void ringRead(uint32_t pos, uint8_t* data, uint16_t len);
+  void ringWrite(uint32_t pos, const uint8_t* data, uint16_t len);
+  void dropOldest(void);
+  static uint16_t produce(uint8_t* data, uint16_t maxlen, uint32_t offset,
+                          void* context);
+
+  Adafruit_FONA* _fona;
+  FONAStorage* _storage;
+  char* _url;
+  FONAFlashStringPtr _contenttype;
+  uint32_t _capacity;
+  uint32_t _head;
+  uint32_t _used;
+  uint16_t _count;
+  uint32_t _maxbytes;
+  uint32_t _maxage;
+  uint32_t _since;
+  uint32_t _attempt;
+  bool _due;
+  bool _failed;
+  uint32_t _rdpos;
+  uint16_t _rdleft;
+};
+
+#endif
@@ -0,0 +1,729 @@
+/*!
+ * @file FONASMSPDU.cpp
+ *
+ * SMS PDU mode codec: GSM 7 bit and UCS2 text, SMS-SUBMIT encoding with
+ * concatenation headers and SMS-DELIVER/SUBMIT decoding. PDUs are streamed
+ * as hex straight to and from the module, never held in RAM.
+ *
+ * BSD license, all text above must be included in any redistribution
+ */
+
+#include "FONASMSPDU.h"
+
+// Characters per message, and per part of a concatenated message
+#define FONA_SMS_GSM7_SINGLE 160
+#define FONA_SMS_GSM7_PART 153
+#define FONA_SMS_UCS2_SINGLE 70
+#define FONA_SMS_UCS2_PART 67
+
+// Escape to the GSM 7 bit extension table
+#define FONA_GSM7_ESC 0x1B
+
+static const char hexdigits[] PROGMEM = "0123456789ABCDEF";
+static const char bcddigits[] PROGMEM = "0123456789*#abc";
+
+// GSM 03.38 default alphabet, indexed by septet. ESC decodes as a space.
+static const uint16_t gsm7table[128] PROGMEM = {
+    0x0040, 0x00A3, 0x0024, 0x00A5, 0x00E8, 0x00E9, 0x00F9, 0x00EC,
+    0x00F2, 0x00C7, 0x000A, 0x00D8, 0x00F8, 0x000D, 0x00C5, 0x00E5,
+    0x0394, 0x005F, 0x03A6, 0x0393, 0x039B, 0x03A9, 0x03A0, 0x03A8,
+    0x03A3, 0x0398, 0x039E, 0x00A0, 0x00C6, 0x00E6, 0x00DF, 0x00C9,
+    0x0020, 0x0021, 0x0022, 0x0023, 0x00A4, 0x0025, 0x0026, 0x0027,
+    0x0028, 0x0029, 0x002A, 0x002B, 0x002C, 0x002D, 0x002E, 0x002F,
+    0x0030, 0x0031, 0x0032, 0x0033, 0x0034, 0x0035, 0x0036, 0x0037,
+    0x0038, 0x0039, 0x003A, 0x003B, 0x003C, 0x003D, 0x003E, 0x003F,
+    0x00A1, 0x0041, 0x0042, 0x0043, 0x0044, 0x0045, 0x0046, 0x0047,
+    0x0048, 0x0049, 0x004A, 0x004B, 0x004C, 0x004D, 0x004E, 0x004F,
+    0x0050, 0x0051, 0x0052, 0x0053, 0x0054, 0x0055, 0x0056, 0x0057,
+    0x0058, 0x0059, 0x005A, 0x00C4, 0x00D6, 0x00D1, 0x00DC, 0x00A7,
+    0x00BF, 0x0061, 0x0062, 0x0063, 0x0064, 0x0065, 0x0066, 0x0067,
+    0x0068, 0x0069, 0x006A, 0x006B, 0x006C, 0x006D, 0x006E, 0x006F,
+    0x0070, 0x0071, 0x0072, 0x0073, 0x0074, 0x0075, 0x0076, 0x0077,
+    0x0078, 0x0079, 0x007A, 0x00E4, 0x00F6, 0x00F1, 0x00FC, 0x00E0};
+
+// GSM 03.38 extension table, reached through ESC
+#define FONA_GSM7_EXT_COUNT 10
+static const uint8_t gsm7extcode[FONA_GSM7_EXT_COUNT] PROGMEM = {
+    0x0A, 0x14, 0x28, 0x29, 0x2F, 0x3C, 0x3D, 0x3E, 0x40, 0x65};
+static const uint16_t gsm7extchar[FONA_GSM7_EXT_COUNT] PROGMEM = {
+    0x000C, 0x005E, 0x007B, 0x007D, 0x005C,
+    0x005B, 0x007E, 0x005D, 0x007C, 0x20AC};
+
+/********* HEX STREAMS **************************************************/
+
+/**
+ * @brief Construct a new FONAPDUWriter object
+ *
+ * @param out Where to write the hex
+ */
+FONAPDUWriter::FONAPDUWriter(Print& out) {
+  _out = &out;
+  _acc = 0;
+  _nbits = 0;
+}
+
+/**
+ * @brief Write an octet as two hex digits
+ *
+ * @param v The octet
+ */
+void FONAPDUWriter::octet(uint8_t v) {
+  _out->write(pgm_read_byte(&hexdigits[v >> 4]));
+  _out->write(pgm_read_byte(&hexdigits[v & 0x0F]));
+}
+
+/**
+ * @brief Start packing septets
+ *
+ * @param fill Zero bits to put first, so the septets line up after a user
+ * data header
+ */
+void FONAPDUWriter::beginSeptets(uint8_t fill) {
+  _acc = 0;
+  _nbits = fill;
+}
+
+/**
+ * @brief Pack a septet
+ *
+ * @param v The septet
+ */
+void FONAPDUWriter::septet(uint8_t v) {
+  _acc |= (uint16_t)(v & 0x7F) << _nbits;
+  _nbits += 7;
+  if (_nbits >= 8) {
+    octet(_acc);
+    _acc >>= 8;
+    _nbits -= 8;
+  }
+}
+
+/**
+ * @brief Write out the last partly filled octet
+ *
+ */
+void FONAPDUWriter::endSeptets(void) {
+  if (_nbits)
+    octet(_acc);
+  _acc = 0;
+  _nbits = 0;
+}
+
+/**
+ * @brief Construct a new FONAPDUReader object
+ *
+ * @param in Where to read the hex from
+ * @param timeout Give up after this many milliseconds without data
+ */
+FONAPDUReader::FONAPDUReader(FONAStreamType& in, uint16_t timeout) {
+  _in = &in;
+  _timeout = timeout;
+  _acc = 0;
+  _nbits = 0;
+  _failed = false;
+}
+
+/**
+ * @brief Wait for the next character
+ *
+ * @return int16_t The character, -1 on timeout
+ */
+int16_t FONAPDUReader::next(void) {
+  uint16_t idle = 0;
+  while (!_in->available()) {
+    if (idle++ >= _timeout)
+      return -1;
+    delay(1);
+  }
+  return _in->read();
+}
+
+/**
+ * @brief Read an octet from two hex digits
+ *
+ * @return uint8_t The octet, 0 once the PDU has ended or was malformed
+ */
+uint8_t FONAPDUReader::octet(void) {
+  uint8_t v = 0;
+
+  for (uint8_t i = 0; (i < 2) && !_failed; i++) {
+    int16_t c = next();
+    if ((c >= '0') && (c <= '9'))
+      v = (v << 4) | (c - '0');
+    else if ((c >= 'A') && (c <= 'F'))
+      v = (v << 4) | (c - 'A' + 10);
+    else if ((c >= 'a') && (c <= 'f'))
+      v = (v << 4) | (c - 'a' + 10);
+    else
+      _failed = true;
+  }
+
+  return _failed ? 0 : v;
+}
+
+/**
+ * @brief Start unpacking septets
+ *
+ * @param fill Bits to skip first, after a user data header
+ */
+void FONAPDUReader::beginSeptets(uint8_t fill) {
+  _acc = 0;
+  _nbits = 0;
+  if (fill) {
+    _acc = octet() >> fill;
+    _nbits = 8 - fill;
+  }
+}
+
+/**
+ * @brief Unpack a septet
+ *
+ * @return uint8_t The septet
+ */
+uint8_t FONAPDUReader::septet(void) {
+  if (_nbits < 7) {
+    _acc |= (uint16_t)octet() << _nbits;
+    _nbits += 8;
+  }
+  uint8_t v = _acc & 0x7F;
+  _acc >>= 7;
+  _nbits -= 7;
+  return v;
+}
+
+/**
+ * @brief Drop the rest of the PDU line
+ *
+ */
+void FONAPDUReader::skipLine(void) {
+  int16_t c;
+  do {
+    c = next();
+  } while ((c >= 0) && (c != '\n'));
+}
+
+/**
+ * @brief Check whether the PDU ended early or held a non hex character
+ *
+ * @return true: failed, false: ok so far
+ */
+bool FONAPDUReader::failed(void) {
+  return _failed;
+}
+
+/********* CHARACTER SETS ***********************************************/
+
+/**
+ * @brief Decode one UTF-8 character. Characters outside the Basic
+ * Multilingual Plane and malformed sequences decode as U+FFFD.
+ *
+ * @param p Pointer to the parse position, moved past the character. Must
+ * not point at the terminator.
+ * @return uint16_t The character
+ */
+uint16_t FONAutf8Decode(const char** p) {
+  const uint8_t* s = (const uint8_t*)*p;
+  uint16_t ch = *s++;
+  uint8_t more = 0;
+
+  if (ch >= 0x80) {
+    if ((ch & 0xE0) == 0xC0) {
+      ch &= 0x1F;
+      more = 1;
+    } else if ((ch & 0xF0) == 0xE0) {
+      ch &= 0x0F;
+      more = 2;
+    } else {
+      ch = 0xFFFD;
+      while ((*s & 0xC0) == 0x80)
+        s++;
+    }
+  }
+
+  for (uint8_t i = 0; i < more; i++) {
+    if ((*s & 0xC0) != 0x80) {
+      ch = 0xFFFD;
+      break;
+    }
+    ch = (ch << 6) | (*s++ & 0x3F);
+  }
+
+  *p = (const char*)s;
+  return ch;
+}
+
+/**
+ * @brief Look a character up in the GSM 7 bit alphabet
+ *
+ * @param ch The character
+ * @param code Set to the septet
+ * @param ext Set to true if the septet is in the extension table and must
+ * follow an ESC
+ * @return true: found, false: the character needs UCS2
+ */
+bool FONAgsm7Encode(uint16_t ch, uint8_t* code, bool* ext) {
+  *ext = false;
+
+  // most ASCII letters and digits sit at their own code
+  if ((ch < 128) && (ch != FONA_GSM7_ESC) &&
+      (pgm_read_word(&gsm7table[ch]) == ch)) {
+    *code = ch;
+    return true;
+  }
+
+  for (uint8_t i = 0; i < 128; i++) {
+    if ((i != FONA_GSM7_ESC) && (pgm_read_word(&gsm7table[i]) == ch)) {
+      *code = i;
+      return true;
+    }
+  }
+
+  for (uint8_t i = 0; i < FONA_GSM7_EXT_COUNT; i++) {
+    if (pgm_read_word(&gsm7extchar[i]) == ch) {
+      *code = pgm_read_byte(&gsm7extcode[i]);
+      *ext = true;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/**
+ * @brief Convert a GSM 7 bit septet to a character
+ *
+ * @param code The septet
+ * @param ext true if it followed an ESC
+ * @return uint16_t The character
+ */
+uint16_t FONAgsm7Decode(uint8_t code, bool ext) {
+  code &= 0x7F;
+  if (ext) {
+    for (uint8_t i = 0; i < FONA_GSM7_EXT_COUNT; i++) {
+      if (pgm_read_byte(&gsm7extcode[i]) == code)
+        return pgm_read_word(&gsm7extchar[i]);
+    }
+  }
+  return pgm_read_word(&gsm7table[code]);
+}
+
+/**
+ * @brief Append a character to a UTF-8 buffer. Once a character doesn't fit
+ * nothing more is stored, but the full length is still counted.
+ *
+ * @param ch The character
+ * @param text The buffer
+ * @param maxlen The size of the buffer, including the terminator
+ * @param len The full length so far
+ * @param stored The bytes stored so far
+ */
+static void putUTF8(uint16_t ch, char* text, uint16_t maxlen, uint16_t* len,
+                    uint16_t* stored) {
+  char buf[3];
+  uint8_t n;
+
+  if (ch < 0x80) {
+    buf[0] = ch;
+    n = 1;
+  } else if (ch < 0x800) {
+    buf[0] = 0xC0 | (ch >> 6);
+    buf[1] = 0x80 | (ch & 0x3F);
+    n = 2;
+  } else {
+    buf[0] = 0xE0 | (ch >> 12);
+    buf[1] = 0x80 | ((ch >> 6) & 0x3F);
+    buf[2] = 0x80 | (ch & 0x3F);
+    n = 3;
+  }
+
+  if ((*stored == *len) && (*len + n < maxlen)) {
+    memcpy(text + *stored, buf, n);
+    *stored += n;
+  }
+  *len += n;
+}
+
+/********* SMS-SUBMIT ***************************************************/
+
+/**
+ * @brief Pick the coding for a message and count the parts it needs
+ *
+ * @param text The message, UTF-8
+ * @param dcs Set to FONA_SMS_DCS_GSM7 if every character is in the GSM 7
+ * bit alphabet, FONA_SMS_DCS_UCS2 otherwise
+ * @return uint8_t The number of parts, 0 if the text needs more than 255
+ */
+uint8_t FONAsmsParts(const char* text, uint8_t* dcs) {
+  *dcs = FONA_SMS_DCS_GSM7;
+  for (const char* p = text; *p;) {
+    uint8_t code;
+    bool ext;
+    if (!FONAgsm7Encode(FONAutf8Decode(&p), &code, &ext)) {
+      *dcs = FONA_SMS_DCS_UCS2;
+      break;
+    }
+  }
+
+  uint8_t units;
+  const char* p = FONAsmsPart(text, *dcs, false, &units);
+  if (*p == 0)
+    return 1;
+
+  uint8_t parts = 0;
+  for (p = text; *p; parts++) {
+    if (parts == 255)
+      return 0;
+    p = FONAsmsPart(p, *dcs, true, &units);
+  }
+  return parts;
+}
+
+/**
+ * @brief Find where a part of a message ends. Parts only break between
+ * characters, never inside an ESC sequence.
+ *
+ * @param text Start of the part
+ * @param dcs FONA_SMS_DCS_GSM7 or FONA_SMS_DCS_UCS2
+ * @param concat true if the part carries a concatenation header
+ * @param units Set to the septets (GSM 7 bit) or characters (UCS2) in it
+ * @return const char* The end of the part
+ */
+const char* FONAsmsPart(const char* text, uint8_t dcs, bool concat,
+                        uint8_t* units) {
+  uint8_t max;
+  if (dcs == FONA_SMS_DCS_GSM7)
+    max = concat ? FONA_SMS_GSM7_PART : FONA_SMS_GSM7_SINGLE;
+  else
+    max = concat ? FONA_SMS_UCS2_PART : FONA_SMS_UCS2_SINGLE;
+
+  *units = 0;
+  while (*text) {
+    const char* next = text;
+    uint16_t ch = FONAutf8Decode(&next);
+
+    uint8_t cost = 1;
+    uint8_t code;
+    bool ext;
+    if ((dcs == FONA_SMS_DCS_GSM7) && FONAgsm7Encode(ch, &code, &ext) && ext)
+      cost = 2;
+
+    if (*units + cost > max)
+      break;
+    *units += cost;
+    text = next;
+  }
+
+  return text;
+}
+
+/**
+ * @brief Count the digits of a phone number
+ *
+ * @param addr The number, optionally starting with +
+ * @return uint8_t The number of digits
+ */
+static uint8_t addressDigits(const char* addr) {
+  uint8_t digits = 0;
+  for (; *addr; addr++) {
+    if ((*addr >= '0') && (*addr <= '9'))
+      digits++;
+  }
+  return digits;
+}
+
+/**
+ * @brief Get the length AT+CMGS needs for an SMS-SUBMIT PDU, which leaves
+ * out the service centre address
+ *
+ * @param addr The recipient
+ * @param dcs FONA_SMS_DCS_GSM7 or FONA_SMS_DCS_UCS2
+ * @param concat true if the part carries a concatenation header
+ * @param units The septets or characters in the part, from FONAsmsPart()
+ * @return uint8_t The TPDU length in octets
+ */
+uint8_t FONAsmsSubmitLength(const char* addr, uint8_t dcs, bool concat,
+                            uint8_t units) {
+  uint8_t ud;
+  if (dcs == FONA_SMS_DCS_GSM7) {
+    uint16_t septets = (concat ? 7 : 0) + units;
+    ud = (septets * 7 + 7) / 8;
+  } else {
+    ud = (concat ? 6 : 0) + 2 * units;
+  }
+
+  // first octet, message reference, address length and type, protocol
+  // identifier, coding scheme and user data length
+  return 7 + (addressDigits(addr) + 1) / 2 + ud;
+}
+
+/**
+ * @brief Write an SMS-SUBMIT PDU as hex, ready to follow AT+CMGS
+ *
+ * @param out Where to write the PDU
+ * @param addr The recipient, optionally starting with +
+ * @param text Start of the part, UTF-8
+ * @param end End of the part, from FONAsmsPart()
+ * @param dcs FONA_SMS_DCS_GSM7 or FONA_SMS_DCS_UCS2
+ * @param concat The concatenation header to add, 0 for a single message
+ * @param units The septets or characters in the part, from FONAsmsPart()
+ */
+void FONAwriteSubmit(Print& out, const char* addr, const char* text,
+                     const char* end, uint8_t dcs,
+                     const FONASMSConcat* concat, uint8_t units) {
+  FONAPDUWriter pdu(out);
+
+  pdu.octet(0x00);                  // service centre from the SIM
+  pdu.octet(concat ? 0x41 : 0x01);  // SMS-SUBMIT, user data header
+  pdu.octet(0x00);                  // message reference set by the module
+
+  uint8_t digits = addressDigits(addr);
+  pdu.octet(digits);
+  pdu.octet((addr[0] == '+') ? 0x91 : 0x81);
+  uint8_t pending = 0xFF;
+  for (; *addr; addr++) {
+    if ((*addr < '0') || (*addr > '9'))
+      continue;
+    if (pending == 0xFF) {
+      pending = *addr - '0';
+    } else {
+      pdu.octet(((*addr - '0') << 4) | pending);
+      pending = 0xFF;
+    }
+  }
+  if (pending != 0xFF)
+    pdu.octet(0xF0 | pending);
+
+  pdu.octet(0x00); // protocol identifier
+  pdu.octet(dcs);
+
+  if (dcs == FONA_SMS_DCS_GSM7)
+    pdu.octet((concat ? 7 : 0) + units);
+  else
+    pdu.octet((concat ? 6 : 0) + 2 * units);
+
+  if (concat) {
+    pdu.octet(5);    // header length
+    pdu.octet(0x00); // concatenation, 8 bit reference
+    pdu.octet(3);
+    pdu.octet(concat->ref);
+    pdu.octet(concat->total);
+    pdu.octet(concat->seq);
+  }
+
+  if (dcs == FONA_SMS_DCS_GSM7) {
+    pdu.beginSeptets(concat ? 1 : 0);
+    while (text < end) {
+      uint8_t code;
+      bool ext;
+      if (!FONAgsm7Encode(FONAutf8Decode(&text), &code, &ext))
+        code = '?';
+      if (ext)
+        pdu.septet(FONA_GSM7_ESC);
+      pdu.septet(code);
+    }
+    pdu.endSeptets();
+  } else {
+    while (text < end) {
+      uint16_t ch = FONAutf8Decode(&text);
+      pdu.octet(ch >> 8);
+      pdu.octet(ch);
+    }
+  }
+}
+
+/********* SMS-DELIVER **************************************************/
+
+/**
+ * @brief Read an address field
+ *
+ * @param in The PDU
+ * @param out Buffer for the address
+ * @param size The size of the buffer
+ */
+static void readAddress(FONAPDUReader& in, char* out, uint8_t size) {
+  uint8_t digits = in.octet();
+  uint8_t type = in.octet();
+  uint8_t octets = (digits + 1) / 2;
+  uint8_t o = 0;
+
+  if ((type & 0x70) == 0x50) {
+    // alphanumeric sender, GSM 7 bit packed
+    uint8_t septets = digits * 4 / 7;
+    in.beginSeptets(0);
+    for (uint8_t i = 0; i < septets; i++) {
+      uint16_t ch = FONAgsm7Decode(in.septet(), false);
+      if (o < size - 1)
+        out[o++] = (ch < 0x80) ? ch : '?';
+    }
+    for (uint8_t i = (septets * 7 + 7) / 8; i < octets; i++)
+      in.octet();
+  } else {
+    if ((type == 0x91) && (o < size - 1))
+      out[o++] = '+';
+    for (uint8_t i = 0; i < octets; i++) {
+      uint8_t v = in.octet();
+      uint8_t lo = v & 0x0F;
+      uint8_t hi = v >> 4;
+      if ((lo != 0x0F) && (o < size - 1))
+        out[o++] = pgm_read_byte(&bcddigits[lo]);
+      if ((hi != 0x0F) && (o < size - 1))
+        out[o++] = pgm_read_byte(&bcddigits[hi]);
+    }
+  }
+
+  out[o] = 0;
+}
+
+/**
+ * @brief Read a service centre timestamp
+ *
+ * @param in The PDU
+ * @param out Buffer for "yy/MM/dd,hh:mm:ss+zz", at least 21 bytes
+ */
+static void readTimestamp(FONAPDUReader& in, char* out) {
+  static const char separators[] PROGMEM = "//,::";
+
+  for (uint8_t i = 0; i < 6; i++) {
+    uint8_t v = in.octet();
+    *out++ = '0' + (v & 0x0F);
+    *out++ = '0' + (v >> 4);
+    if (i < 5)
+      *out++ = pgm_read_byte(&separators[i]);
+  }
+
+  // time zone in quarter hours, with the sign in bit 3
+  uint8_t v = in.octet();
+  uint8_t quarters = (v & 0x07) * 10 + (v >> 4);
+  *out++ = (v & 0x08) ? '-' : '+';
+  *out++ = '0' + quarters / 10;
+  *out++ = '0' + quarters % 10;
+  *out = 0;
+}
+
+/**
+ * @brief Parse a received (SMS-DELIVER) or stored (SMS-SUBMIT) PDU, as
+ * listed by AT+CMGR or AT+CMGL in PDU mode
+ *
+ * @param in The PDU
+ * @param header Filled with the address, timestamp and full text length
+ * @param concat Filled from the concatenation header, if any
+ * @param text Buffer for the text as UTF-8, or 0 to stop after the headers
+ * @param maxlen The size of the text buffer, including the terminator. At
+ * least 1 if text is given.
+ * @return true: success, false: the PDU was cut short or malformed
+ */
+bool FONAreadPDU(FONAPDUReader& in, FONASMSHeader* header,
+                 FONASMSConcat* concat, char* text, uint16_t maxlen) {
+  header->address[0] = 0;
+  header->timestamp[0] = 0;
+  header->length = 0;
+  concat->ref = 0;
+  concat->total = 1;
+  concat->seq = 1;
+
+  // service centre address
+  for (uint8_t n = in.octet(); n && !in.failed(); n--)
+    in.octet();
+
+  uint8_t first = in.octet();
+  bool submit = (first & 0x03) == 0x01;
+  if (submit)
+    in.octet(); // message reference
+
+  readAddress(in, header->address, sizeof(header->address));
+  in.octet(); // protocol identifier
+  uint8_t dcs = in.octet();
+
+  if (!submit) {
+    readTimestamp(in, header->timestamp);
+  } else {
+    // validity period: none, relative, enhanced or absolute
+    uint8_t vpf = (first >> 3) & 0x03;
+    uint8_t skip = (vpf == 0) ? 0 : ((vpf == 2) ? 1 : 7);
+    while (skip--)
+      in.octet();
+  }
+
+  uint8_t alphabet = FONA_SMS_DCS_GSM7;
+  if ((dcs & 0xC0) == 0x00)
+    alphabet = dcs & 0x0C;
+  else if ((dcs & 0xF0) == 0xE0)
+    alphabet = FONA_SMS_DCS_UCS2;
+  else if ((dcs & 0xF0) == 0xF0)
+    alphabet = dcs & FONA_SMS_DCS_8BIT;
+
+  uint8_t udl = in.octet();
+  uint8_t udhlen = 0;
+  if (first & 0x40) {
+    udhlen = in.octet() + 1;
+    uint8_t left = udhlen - 1;
+    while ((left >= 2) && !in.failed()) {
+      uint8_t iei = in.octet();
+      uint8_t iel = in.octet();
+      left -= 2;
+      if (iel > left)
+        iel = left;
+      left -= iel;
+
+      bool matched = false;
+      if ((iei == 0x00) && (iel == 3)) {
+        concat->ref = in.octet();
+        matched = true;
+      } else if ((iei == 0x08) && (iel == 4)) {
+        concat->ref = in.octet() << 8;
+        concat->ref |= in.octet();
+        matched = true;
+      }
+      if (matched) {
+        concat->total = in.octet();
+        concat->seq = in.octet();
+      } else {
+        while (iel--)
+          in.octet();
+      }
+    }
+    while (left--)
+      in.octet();
+  }
+
+  if (in.failed())
+    return false;
+  if (!text)
+    return true;
+
+  uint16_t len = 0;
+  uint16_t stored = 0;
+
+  if (alphabet == FONA_SMS_DCS_GSM7) {
+    // the header takes whole septets, padded with fill bits
+    uint8_t skip = (udhlen * 8 + 6) / 7;
+    in.beginSeptets(skip * 7 - udhlen * 8);
+    bool esc = false;
+    for (uint8_t i = skip; i < udl; i++) {
+      uint8_t code = in.septet();
+      if ((code == FONA_GSM7_ESC) && !esc) {
+        esc = true;
+        continue;
+      }
+      putUTF8(FONAgsm7Decode(code, esc), text, maxlen, &len, &stored);
+      esc = false;
+    }
+  } else {
+    uint8_t octets = (udl > udhlen) ? udl - udhlen : 0;
+    if (alphabet == FONA_SMS_DCS_UCS2) {
+      for (uint8_t i = 0; i + 1 < octets; i += 2) {
+        uint16_t ch = in.octet() << 8;
+        ch |= in.octet();
+        putUTF8(ch, text, maxlen, &len, &stored);
+      }
+    } else {
+      // 8 bit data, shown as Latin-1
+      for (uint8_t i = 0; i < octets; i++)
+        putUTF8(in.octet(), text, maxlen, &len, &stored);
+    }
+  }
+
+  text[stored] = 0;
+  header->length = len;
+  return !in.failed();
+}
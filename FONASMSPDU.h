@@ -0,0 +1,72 @@
+/*!
+ * @file FONASMSPDU.h
+ *
+ * SMS PDU mode codec: GSM 7 bit and UCS2 text, SMS-SUBMIT encoding with
+ * concatenation headers and SMS-DELIVER/SUBMIT decoding. PDUs are streamed
+ * as hex straight to and from the module, never held in RAM.
+ *
+ * BSD license, all text above must be included in any redistribution
+ */
+#ifndef FONA_SMS_PDU_H
+#define FONA_SMS_PDU_H
+
+#include "Adafruit_FONA.h"
+
+// Data coding schemes
+#define FONA_SMS_DCS_GSM7 0x00
+#define FONA_SMS_DCS_8BIT 0x04
+#define FONA_SMS_DCS_UCS2 0x08
+
+/** Writes PDU octets as hex, packing septets for GSM 7 bit text */
+class FONAPDUWriter {
+ public:
+  FONAPDUWriter(Print& out);
+
+  void octet(uint8_t v);
+  void beginSeptets(uint8_t fill);
+  void septet(uint8_t v);
+  void endSeptets(void);
+
+ private:
+  Print* _out;
+  uint16_t _acc;
+  uint8_t _nbits;
+};
+
+/** Reads PDU octets from hex, unpacking septets for GSM 7 bit text */
+class FONAPDUReader {
+ public:
+  FONAPDUReader(FONAStreamType& in, uint16_t timeout);
+
+  uint8_t octet(void);
+  void beginSeptets(uint8_t fill);
+  uint8_t septet(void);
+  void skipLine(void);
+  bool failed(void);
+
+ private:
+  int16_t next(void);
+
+  FONAStreamType* _in;
+  uint16_t _timeout;
+  uint16_t _acc;
+  uint8_t _nbits;
+  bool _failed;
+};
+
+uint16_t FONAutf8Decode(const char** p);
+bool FONAgsm7Encode(uint16_t ch, uint8_t* code, bool* ext);
+uint16_t FONAgsm7Decode(uint8_t code, bool ext);
+
+uint8_t FONAsmsParts(const char* text, uint8_t* dcs);
+const char* FONAsmsPart(const char* text, uint8_t dcs, bool concat,
+                        uint8_t* units);
+uint8_t FONAsmsSubmitLength(const char* addr, uint8_t dcs, bool concat,
+                            uint8_t units);
+void FONAwriteSubmit(Print& out, const char* addr, const char* text,
+                     const char* end, uint8_t dcs,
+                     const FONASMSConcat* concat, uint8_t units);
+bool FONAreadPDU(FONAPDUReader& in, FONASMSHeader* header,
+                 FONASMSConcat* concat, char* text, uint16_t maxlen);
+
+#endif
@@ -0,0 +1,122 @@
+/*!
+ * @file FONAStorage.cpp
+ *
+ * Byte addressed storage for data that has to outlive a request, such as the
+ * FONAOutbox ring. Implementations for a RAM buffer and the AVR EEPROM.
+ *
+ * BSD license, all text above must be included in any redistribution
+ */
+
+#include "FONAStorage.h"
+
+#if defined(__AVR__)
+#include <avr/eeprom.h>
+#endif
+
+/********* RAM **********************************************************/
+
+/**
+ * @brief Construct a new FONARAMStorage object
+ *
+ * @param buffer The buffer to store into
+ * @param size The size of the buffer
+ */
+FONARAMStorage::FONARAMStorage(uint8_t* buffer, uint32_t size) {
+  _buffer = buffer;
+  _size = size;
+}
+
+/**
+ * @brief Get the storage size
+ *
+ * @return uint32_t The size of the buffer
+ */
+uint32_t FONARAMStorage::size(void) {
+  return _size;
+}
+
+/**
+ * @brief Read bytes from the buffer
+ *
+ * @param addr Offset of the first byte
+ * @param data Buffer to fill
+ * @param len The number of bytes
+ * @return true: success, false: out of range
+ */
+bool FONARAMStorage::read(uint32_t addr, uint8_t* data, uint16_t len) {
+  if ((addr > _size) || (len > _size - addr))
+    return false;
+  memcpy(data, _buffer + addr, len);
+  return true;
+}
+
+/**
+ * @brief Write bytes to the buffer
+ *
+ * @param addr Offset of the first byte
+ * @param data The bytes to write
+ * @param len The number of bytes
+ * @return true: success, false: out of range
+ */
+bool FONARAMStorage::write(uint32_t addr, const uint8_t* data,
+                           uint16_t len) {
+  if ((addr > _size) || (len > _size - addr))
+    return false;
+  memcpy(_buffer + addr, data, len);
+  return true;
+}
+
+/********* EEPROM *******************************************************/
+
+#if defined(__AVR__)
+/**
+ * @brief Construct a new FONAEEPROMStorage object
+ *
+ * @param start The first EEPROM address to use
+ * @param size The number of bytes to use
+ */
+FONAEEPROMStorage::FONAEEPROMStorage(uint16_t start, uint16_t size) {
+  _start = start;
+  _size = size;
+}
+
+/**
+ * @brief Get the storage size
+ *
+ * @return uint32_t The size of the EEPROM region
+ */
+uint32_t FONAEEPROMStorage::size(void) {
+  return _size;
+}
+
+/**
+ * @brief Read bytes from the EEPROM
+ *
+ * @param addr Offset of the first byte within the region
+ * @param data Buffer to fill
+ * @param len The number of bytes
+ * @return true: success, false: out of range
+ */
+bool FONAEEPROMStorage::read(uint32_t addr, uint8_t* data, uint16_t len) {
+  if ((addr > _size) || (len > _size - addr))
+    return false;
+  eeprom_read_block(data, (const void*)(uintptr_t)(_start + addr), len);
+  return true;
+}
+
+/**
+ * @brief Write bytes to the EEPROM, skipping bytes that already match
+ *
+ * @param addr Offset of the first byte within the region
+ * @param data The bytes to write
+ * @param len The number of bytes
+ * @return true: success, false: out of range
+ */
+bool FONAEEPROMStorage::write(uint32_t addr, const uint8_t* data,
+                              uint16_t len) {
+  if ((addr > _size) || (len > _size - addr))
+    return false;
+  eeprom_update_block(data, (void*)(uintptr_t)(_start + addr), len);
+  return true;
+}
+#endif
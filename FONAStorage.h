@@ -0,0 +1,74 @@
+/*!
+ * @file FONAStorage.h
+ *
+ * Byte addressed storage for data that has to outlive a request, such as the
+ * FONAOutbox ring. Implementations for a RAM buffer and the AVR EEPROM.
+ *
+ * BSD license, all text above must be included in any redistribution
+ */
+#ifndef FONA_STORAGE_H
+#define FONA_STORAGE_H
+
+#include "Adafruit_FONA.h"
+
+/** Byte addressed storage */
+class FONAStorage {
+ public:
+  /**
+   * @brief Get the storage size
+   *
+   * @return uint32_t The number of bytes that can be stored
+   */
+  virtual uint32_t size(void) = 0;
+  /**
+   * @brief Read bytes
+   *
+   * @param addr Address of the first byte
+   * @param data Buffer to fill
+   * @param len The number of bytes
+   * @return true: success, false: failure
+   */
+  virtual bool read(uint32_t addr, uint8_t* data, uint16_t len) = 0;
+  /**
+   * @brief Write bytes
+   *
+   * @param addr Address of the first byte
+   * @param data The bytes to write
+   * @param len The number of bytes
+   * @return true: success, false: failure
+   */
+  virtual bool write(uint32_t addr, const uint8_t* data, uint16_t len) = 0;
+};
+
+/** Storage in a caller supplied RAM buffer, kept only while powered */
+class FONARAMStorage : public FONAStorage {
+ public:
+  FONARAMStorage(uint8_t* buffer, uint32_t size);
+
+  uint32_t size(void);
+  bool read(uint32_t addr, uint8_t* data, uint16_t len);
+  bool write(uint32_t addr, const uint8_t* data, uint16_t len);
+
+ private:
+  uint8_t* _buffer;
+  uint32_t _size;
+};
+
+#if defined(__AVR__)
+/** Storage in a region of the AVR EEPROM. Unchanged bytes are not
+ * rewritten, to spare the cells. */
+class FONAEEPROMStorage : public FONAStorage {
+ public:
+  FONAEEPROMStorage(uint16_t start, uint16_t size);
+
+  uint32_t size(void);
+  bool read(uint32_t addr, uint8_t* data, uint16_t len);
+  bool write(uint32_t addr, const uint8_t* data, uint16_t len);
+
+ private:
+  uint16_t _start;
+  uint16_t _size;
+};
+#endif
+
+#endif
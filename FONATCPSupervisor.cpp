@@ -0,0 +1,209 @@
+/*!
+ * @file FONATCPSupervisor.cpp
+ *
+ * Keeps a single TCP session alive on top of Adafruit_FONA, reconnecting
+ * with jittered exponential backoff when the link is found dead.
+ *
+ * BSD license, all text above must be included in any redistribution
+ */
+
+#include "FONATCPSupervisor.h"
+
+// The events that mean the connection is gone
+#define FONA_TCP_URCS (FONA_URC_TCP_CLOSED | FONA_URC_PDP_DEACT)
+
+/**
+ * @brief Construct a new FONATCPSupervisor object
+ *
+ * @param fona The module to open connections with
+ */
+FONATCPSupervisor::FONATCPSupervisor(Adafruit_FONA& fona) {
+  _fona = &fona;
+  _server = 0;
+  _port = 0;
+  _state = FONA_TCP_IDLE;
+  _failures = 0;
+  _bearerdown = false;
+  _kaidle = 60;
+  _kainterval = 30;
+  _kacount = 3;
+  _backoffmin = 1000;
+  _backoffmax = 300000;
+  _backoffstart = 0;
+  _backoffwait = 0;
+}
+
+/**
+ * @brief Start supervising a connection. The first attempt is made by the
+ * next poll().
+ *
+ * @param server Pointer to a buffer with the server to connect to. Must stay
+ * valid until end() is called.
+ * @param port The port to connect to
+ */
+void FONATCPSupervisor::begin(char* server, uint16_t port) {
+  _server = server;
+  _port = port;
+  _failures = 0;
+  _bearerdown = false;
+  _state = FONA_TCP_BACKOFF;
+  _backoffstart = millis();
+  _backoffwait = 0;
+}
+
+/**
+ * @brief Stop supervising and close the connection
+ *
+ */
+void FONATCPSupervisor::end(void) {
+  if (_state == FONA_TCP_CONNECTED)
+    _fona->TCPclose();
+  _state = FONA_TCP_IDLE;
+}
+
+/**
+ * @brief Set the keepalive parameters used for each new connection
+ *
+ * @param idle Idle time before the first probe, in seconds (30-7200). 0
+ * disables keepalives.
+ * @param interval Time between probes, in seconds (30-600)
+ * @param count Number of unanswered probes before closing (1-9)
+ */
+void FONATCPSupervisor::setKeepalive(uint16_t idle, uint16_t interval,
+                                     uint8_t count) {
+  _kaidle = idle;
+  _kainterval = interval;
+  _kacount = count;
+}
+
+/**
+ * @brief Set the reconnect backoff limits. The wait doubles after each failed
+ * attempt, starting at min_ms and never exceeding max_ms.
+ *
+ * @param min_ms The wait after the first failure, in milliseconds
+ * @param max_ms The longest wait, in milliseconds
+ */
+void FONATCPSupervisor::setBackoff(uint32_t min_ms, uint32_t max_ms) {
+  _backoffmin = min_ms;
+  _backoffmax = max_ms;
+}
+
+/**
+ * @brief Service the connection. Picks up CLOSED / PDP DEACT events and
+ * reconnects once the backoff time has passed.
+ *
+ * @return uint8_t The state after polling: FONA_TCP_IDLE, FONA_TCP_CONNECTED
+ * or FONA_TCP_BACKOFF
+ */
+uint8_t FONATCPSupervisor::poll(void) {
+  if (_state == FONA_TCP_IDLE)
+    return _state;
+
+  uint8_t urc = _fona->pollURC(0, FONA_TCP_URCS);
+  if (urc & FONA_URC_PDP_DEACT)
+    linkDown(true);
+  else if (urc & FONA_URC_TCP_CLOSED)
+    linkDown(false);
+
+  if ((_state == FONA_TCP_BACKOFF) &&
+      ((uint32_t)(millis() - _backoffstart) >= _backoffwait))
+    reconnect();
+
+  return _state;
+}
+
+/**
+ * @brief Check whether the session is believed to be up
+ *
+ * @return true: connected, false: down or not supervising
+ */
+bool FONATCPSupervisor::connected(void) {
+  return _state == FONA_TCP_CONNECTED;
+}
+
+/**
+ * @brief Send data on the supervised connection. A failed send marks the
+ * link down so the next poll() starts reconnecting.
+ *
+ * @param data Pointer to a buffer with the data to send
+ * @param len length of the data to send
+ * @return true: success, false: failure
+ */
+bool FONATCPSupervisor::send(char* data, uint8_t len) {
+  if (_state != FONA_TCP_CONNECTED)
+    return false;
+
+  if (_fona->TCPsend(data, len))
+    return true;
+
+  linkDown(_fona->pollURC(0, FONA_TCP_URCS) & FONA_URC_PDP_DEACT);
+  return false;
+}
+
+/**
+ * @brief Mark the link as dead and schedule a reconnect
+ *
+ * @param bearer true if the GPRS bearer was lost too and must be reopened
+ */
+void FONATCPSupervisor::linkDown(bool bearer) {
+  if (_state == FONA_TCP_IDLE)
+    return;
+
+  if (bearer)
+    _bearerdown = true;
+  if (_state == FONA_TCP_BACKOFF)
+    return;
+
+  DEBUG_PRINTLN(F("TCP link down"));
+  _state = FONA_TCP_BACKOFF;
+  _failures = 0;
+  _backoffstart = millis();
+  _backoffwait = 0;
+}
+
+/**
+ * @brief Try to reopen the connection, scheduling the next attempt with
+ * jittered exponential backoff on failure
+ *
+ * @return true: success, false: failure
+ */
+bool FONATCPSupervisor::reconnect(void) {
+  bool ok = true;
+
+  if (_bearerdown)
+    ok = _fona->enableGPRS(true);
+  if (ok)
+    _bearerdown = false;
+
+  if (ok && _kaidle)
+    _fona->TCPkeepalive(true, _kaidle, _kainterval, _kacount);
+
+  if (ok) {
+    // drop events left over from the old connection
+    _fona->pollURC(0, FONA_TCP_URCS);
+    ok = _fona->TCPconnect(_server, _port);
+  }
+
+  if (ok) {
+    _state = FONA_TCP_CONNECTED;
+    _failures = 0;
+    return true;
+  }
+
+  // wait min * 2^failures, capped, then keep a random half of it so a fleet
+  // that lost coverage together doesn't reconnect in lockstep
+  uint32_t wait = _backoffmin;
+  for (uint8_t i = 0; (i < _failures) && (wait < _backoffmax); i++)
+    wait *= 2;
+  if (wait > _backoffmax)
+    wait = _backoffmax;
+  if (_failures < 255)
+    _failures++;
+
+  _backoffwait = wait / 2 + random(wait / 2 + 1);
+  _backoffstart = millis();
+
+  DEBUG_PRINT(F("TCP reconnect failed, retry in "));
+  DEBUG_PRINTLN(_backoffwait);
+  return false;
+}
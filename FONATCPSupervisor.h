@@ -0,0 +1,52 @@
+/*!
+ * @file FONATCPSupervisor.h
+ *
+ * Keeps a single TCP session alive on top of Adafruit_FONA, reconnecting
+ * with jittered exponential backoff when the link is found dead.
+ *
+ * BSD license, all text above must be included in any redistribution
+ */
+#ifndef FONA_TCP_SUPERVISOR_H
+#define FONA_TCP_SUPERVISOR_H
+
+#include "Adafruit_FONA.h"
+
+#define FONA_TCP_IDLE 0      ///< Not supervising
+#define FONA_TCP_CONNECTED 1 ///< Session is up
+#define FONA_TCP_BACKOFF 2   ///< Session is down, waiting to reconnect
+
+/** Supervises a TCP connection: keepalives, dead link detection and
+ * reconnects. Call poll() regularly from loop(). */
+class FONATCPSupervisor {
+ public:
+  FONATCPSupervisor(Adafruit_FONA& fona);
+
+  void begin(char* server, uint16_t port);
+  void end(void);
+  void setKeepalive(uint16_t idle, uint16_t interval, uint8_t count);
+  void setBackoff(uint32_t min_ms, uint32_t max_ms);
+
+  uint8_t poll(void);
+  bool connected(void);
+  bool send(char* data, uint8_t len);
+  void linkDown(bool bearer = false);
+
+ private:
+  bool reconnect(void);
+
+  Adafruit_FONA* _fona;
+  char* _server;
+  uint16_t _port;
+  uint8_t _state;
+  uint8_t _failures;
+  bool _bearerdown;
+  uint16_t _kaidle;
+  uint16_t _kainterval;
+  uint8_t _kacount;
+  uint32_t _backoffmin;
+  uint32_t _backoffmax;
+  uint32_t _backoffstart;
+  uint32_t _backoffwait;
+};
+
+#endif
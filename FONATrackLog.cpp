@@ -0,0 +1,582 @@
+/*!
+ * @file FONATrackLog.cpp
+ *
+ * GPS breadcrumb log: fixes are stored as zigzag varint deltas in fixed size
+ * blocks on a FONAStorage ring, each block starting with a full keyframe, and
+ * exported in the same compact form for upload. A streaming simplifier can
+ * drop the points that add no spatial information before they are logged.
+ *
+ * BSD license, all text above must be included in any redistribution
+ */
+
+#include "FONATrackLog.h"
+
+#if (FONA_TRACK_BLOCK < 24) || (FONA_TRACK_BLOCK > 255)
+#error "FONA_TRACK_BLOCK must be between 24 and 255"
+#endif
+
+// Marks an initialised track log header
+#define FONA_TRACK_MAGIC 0x7A0C
+
+// Longest encoded point: four varints of up to 5 bytes
+#define FONA_TRACK_POINT_MAX 20
+
+/** Ring state kept at the start of the storage */
+typedef struct {
+  uint16_t magic;  ///< FONA_TRACK_MAGIC
+  uint16_t head;   ///< Oldest block
+  uint16_t blocks; ///< Blocks in use, the last one being filled
+  uint16_t check;  ///< Checksum of the fields above
+} FONATrackHeader;
+
+/**
+ * @brief Append a varint, 7 bits per byte with the low bits first
+ *
+ * @param data Buffer to write to
+ * @param v The value
+ * @return uint8_t The number of bytes written
+ */
+static uint8_t putVarint(uint8_t* data, uint32_t v) {
+  uint8_t n = 0;
+  while (v >= 0x80) {
+    data[n++] = (v & 0x7F) | 0x80;
+    v >>= 7;
+  }
+  data[n++] = v;
+  return n;
+}
+
+/**
+ * @brief Append a signed value as a zigzag varint, so small negative values
+ * stay short
+ *
+ * @param data Buffer to write to
+ * @param v The value
+ * @return uint8_t The number of bytes written
+ */
+static uint8_t putZigzag(uint8_t* data, int32_t v) {
+  return putVarint(data, ((uint32_t)v << 1) ^ (uint32_t)(v >> 31));
+}
+
+/**
+ * @brief Read a varint
+ *
+ * @param data The encoded bytes
+ * @param len The number of bytes available
+ * @param pos Position to read at, moved past the varint
+ * @param v Set to the value
+ * @return true: success, false: the varint runs past len
+ */
+static bool getVarint(const uint8_t* data, uint8_t len, uint8_t* pos,
+                      uint32_t* v) {
+  uint32_t r = 0;
+  for (uint8_t shift = 0; (*pos < len) && (shift < 35); shift += 7) {
+    uint8_t b = data[(*pos)++];
+    r |= (uint32_t)(b & 0x7F) << shift;
+    if (!(b & 0x80)) {
+      *v = r;
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * @brief Read a zigzag varint
+ *
+ * @param data The encoded bytes
+ * @param len The number of bytes available
+ * @param pos Position to read at, moved past the varint
+ * @param v Set to the value
+ * @return true: success, false: the varint runs past len
+ */
+static bool getZigzag(const uint8_t* data, uint8_t len, uint8_t* pos,
+                      int32_t* v) {
+  uint32_t u;
+  if (!getVarint(data, len, pos, &u))
+    return false;
+  *v = (int32_t)(u >> 1) ^ -(int32_t)(u & 1);
+  return true;
+}
+
+/**
+ * @brief Checksum the header fields, so a torn or foreign header is not
+ * trusted
+ *
+ * @param h The header
+ * @return uint16_t The checksum
+ */
+static uint16_t headerCheck(const FONATrackHeader* h) {
+  return h->magic ^ h->head ^ h->blocks ^ 0xA5A5;
+}
+
+/**
+ * @brief Construct a new FONATrackLog object
+ *
+ * @param storage Where to keep the track
+ */
+FONATrackLog::FONATrackLog(FONAStorage& storage) {
+  _storage = &storage;
+  _nblocks = 0;
+  _head = 0;
+  _blocks = 0;
+  _points = 0;
+  _curcount = 0;
+  _curlen = 0;
+  rewind();
+}
+
+/**
+ * @brief Load the track from the storage, or start an empty one if there is
+ * none
+ *
+ * @return true: success, false: the storage is smaller than one block
+ */
+bool FONATrackLog::begin(void) {
+  uint32_t size = _storage->size();
+  if (size < sizeof(FONATrackHeader) + FONA_TRACK_BLOCK)
+    return false;
+
+  size = (size - sizeof(FONATrackHeader)) / FONA_TRACK_BLOCK;
+  _nblocks = (size > 0xFFFF) ? 0xFFFF : size;
+
+  if (!load())
+    clear();
+  rewind();
+  return true;
+}
+
+/**
+ * @brief Add a point, dropping the oldest block if the ring is full
+ *
+ * @param point The point
+ * @return true: success, false: begin() was not called or failed
+ */
+bool FONATrackLog::append(const FONATrackPoint* point) {
+  if (!_nblocks)
+    return false;
+
+  uint8_t data[FONA_TRACK_POINT_MAX];
+  uint8_t n = 0;
+  if (_blocks) {
+    n = encode(data, point, false);
+    if (_curlen + n > FONA_TRACK_BLOCK - 2)
+      n = 0;
+  }
+
+  bool newblock = (n == 0);
+  if (newblock) {
+    if (_blocks == _nblocks) {
+      uint8_t count, len;
+      readBlockHeader(_head, &count, &len);
+      _points -= count;
+      _head = (_head + 1) % _nblocks;
+      _blocks--;
+      save();
+    }
+    _blocks++;
+    _curcount = 0;
+    _curlen = 0;
+    n = encode(data, point, true);
+  }
+
+  // the point goes in before the block header that counts it
+  uint32_t addr = blockAddr((_head + _blocks - 1) % _nblocks);
+  _storage->write(addr + 2 + _curlen, data, n);
+  _curcount++;
+  _curlen += n;
+  uint8_t header[2] = {_curcount, _curlen};
+  _storage->write(addr, header, 2);
+  if (newblock)
+    save();
+
+  _points++;
+  _last = *point;
+  return true;
+}
+
+/**
+ * @brief Drop all points, e.g. after a successful upload
+ *
+ */
+void FONATrackLog::clear(void) {
+  _head = 0;
+  _blocks = 0;
+  _points = 0;
+  _curcount = 0;
+  _curlen = 0;
+  save();
+  rewind();
+}
+
+/**
+ * @brief Get the number of points stored
+ *
+ * @return uint16_t The number of points
+ */
+uint16_t FONATrackLog::count(void) {
+  return _points;
+}
+
+/**
+ * @brief Start reading the points from the oldest one
+ *
+ */
+void FONATrackLog::rewind(void) {
+  _rdblock = 0;
+  _rdleft = 0;
+  _rdpos = 0;
+  _rdlen = 0;
+}
+
+/**
+ * @brief Decode the next point, oldest first
+ *
+ * @param point Set to the point
+ * @return true: success, false: no more points
+ */
+bool FONATrackLog::next(FONATrackPoint* point) {
+  while (_rdleft == 0) {
+    if (_rdblock >= _blocks)
+      return false;
+    readBlockHeader((_head + _rdblock) % _nblocks, &_rdleft, &_rdlen);
+    _rdblock++;
+    _rdpos = 0;
+  }
+
+  uint32_t addr = blockAddr((_head + _rdblock - 1) % _nblocks) + 2;
+  uint8_t used =
+      readPoint(addr + _rdpos, _rdlen - _rdpos, _rdpos == 0, &_rdlast);
+  if (!used) {
+    // corrupt block, skip the rest of it
+    _rdleft = 0;
+    return next(point);
+  }
+
+  _rdpos += used;
+  _rdleft--;
+  *point = _rdlast;
+  return true;
+}
+
+/**
+ * @brief Write the encoded track, oldest block first
+ *
+ * @param out Where to write it, e.g. a FONATCPWriter
+ * @return uint32_t The number of bytes written
+ */
+uint32_t FONATrackLog::exportTo(Print& out) {
+  uint32_t total = 0;
+  uint8_t buffer[16];
+
+  for (uint16_t b = 0; b < _blocks; b++) {
+    uint32_t addr = blockAddr((_head + b) % _nblocks);
+    uint8_t count, len;
+    readBlockHeader((_head + b) % _nblocks, &count, &len);
+
+    // the header plus the used part of the block
+    uint16_t left = 2 + len;
+    while (left) {
+      uint8_t n = (left < sizeof(buffer)) ? left : sizeof(buffer);
+      _storage->read(addr, buffer, n);
+      out.write(buffer, n);
+      addr += n;
+      left -= n;
+    }
+    total += 2 + len;
+  }
+
+  return total;
+}
+
+/**
+ * @brief Body writer for HTTP_POST_start() that exports a track log
+ *
+ * @param out Where to write the body
+ * @param context The FONATrackLog
+ */
+void FONATrackLog::writeBody(Print& out, void* context) {
+  ((FONATrackLog*)context)->exportTo(out);
+}
+
+/**
+ * @brief Read the ring state from the storage, and the block being filled
+ *
+ * @return true: a valid track was found, false: the storage is blank or
+ * corrupt
+ */
+bool FONATrackLog::load(void) {
+  FONATrackHeader h;
+  if (!_storage->read(0, (uint8_t*)&h, sizeof(h)))
+    return false;
+
+  if ((h.magic != FONA_TRACK_MAGIC) || (h.check != headerCheck(&h)) ||
+      (h.head >= _nblocks) || (h.blocks > _nblocks))
+    return false;
+
+  _head = h.head;
+  _blocks = h.blocks;
+  _points = 0;
+  _curcount = 0;
+  _curlen = 0;
+
+  uint8_t count, len;
+  for (uint16_t b = 0; b < _blocks; b++) {
+    readBlockHeader((_head + b) % _nblocks, &count, &len);
+    if (len > FONA_TRACK_BLOCK - 2)
+      return false;
+    _points += count;
+  }
+  if (!_blocks)
+    return true;
+
+  // the last point of the block being filled is the base for the next delta
+  _curcount = count;
+  _curlen = len;
+  uint32_t addr = blockAddr((_head + _blocks - 1) % _nblocks) + 2;
+  uint8_t pos = 0;
+  for (uint8_t i = 0; i < count; i++) {
+    uint8_t used = readPoint(addr + pos, len - pos, i == 0, &_last);
+    if (!used)
+      return false;
+    pos += used;
+  }
+  return true;
+}
+
+/**
+ * @brief Write the ring state to the storage
+ *
+ */
+void FONATrackLog::save(void) {
+  FONATrackHeader h;
+  h.magic = FONA_TRACK_MAGIC;
+  h.head = _head;
+  h.blocks = _blocks;
+  h.check = headerCheck(&h);
+  _storage->write(0, (uint8_t*)&h, sizeof(h));
+}
+
+/**
+ * @brief Get the storage address of a block
+ *
+ * @param block The block
+ * @return uint32_t Its address
+ */
+uint32_t FONATrackLog::blockAddr(uint16_t block) {
+  return sizeof(FONATrackHeader) + (uint32_t)block * FONA_TRACK_BLOCK;
+}
+
+/**
+ * @brief Read the header of a block
+ *
+ * @param block The block
+ * @param count Set to the number of points in it
+ * @param len Set to the number of bytes of points in it
+ */
+void FONATrackLog::readBlockHeader(uint16_t block, uint8_t* count,
+                                   uint8_t* len) {
+  uint8_t header[2];
+  _storage->read(blockAddr(block), header, 2);
+  *count = header[0];
+  *len = header[1];
+}
+
+/**
+ * @brief Decode one point from the storage
+ *
+ * @param addr Address of the point
+ * @param avail The number of bytes left in the block
+ * @param key true: the point is a keyframe, false: it is a delta
+ * @param point The point before, replaced by the decoded one
+ * @return uint8_t The number of bytes used, 0 if the point is corrupt
+ */
+uint8_t FONATrackLog::readPoint(uint32_t addr, uint8_t avail, bool key,
+                                FONATrackPoint* point) {
+  uint8_t data[FONA_TRACK_POINT_MAX];
+  if (avail > sizeof(data))
+    avail = sizeof(data);
+  _storage->read(addr, data, avail);
+
+  uint8_t pos = 0;
+  uint32_t time, speed;
+  int32_t lat, lon;
+  if (key) {
+    if (!getVarint(data, avail, &pos, &time) ||
+        !getZigzag(data, avail, &pos, &lat) ||
+        !getZigzag(data, avail, &pos, &lon) ||
+        !getVarint(data, avail, &pos, &speed))
+      return 0;
+    point->time = time;
+    point->lat_udeg = lat;
+    point->lon_udeg = lon;
+    point->speed_cmps = speed;
+  } else {
+    int32_t dtime, dspeed;
+    if (!getZigzag(data, avail, &pos, &dtime) ||
+        !getZigzag(data, avail, &pos, &lat) ||
+        !getZigzag(data, avail, &pos, &lon) ||
+        !getZigzag(data, avail, &pos, &dspeed))
+      return 0;
+    point->time += dtime;
+    point->lat_udeg += lat;
+    point->lon_udeg += lon;
+    point->speed_cmps += dspeed;
+  }
+  return pos;
+}
+
+/**
+ * @brief Encode a point, as a keyframe or as a delta from the last one
+ *
+ * @param data Buffer of at least FONA_TRACK_POINT_MAX bytes
+ * @param point The point
+ * @param key true: encode a keyframe, false: encode a delta
+ * @return uint8_t The number of bytes written
+ */
+uint8_t FONATrackLog::encode(uint8_t* data, const FONATrackPoint* point,
+                             bool key) {
+  uint8_t n = 0;
+  if (key) {
+    n += putVarint(data + n, point->time);
+    n += putZigzag(data + n, point->lat_udeg);
+    n += putZigzag(data + n, point->lon_udeg);
+    n += putVarint(data + n, point->speed_cmps);
+  } else {
+    n += putZigzag(data + n, (int32_t)(point->time - _last.time));
+    n += putZigzag(data + n, point->lat_udeg - _last.lat_udeg);
+    n += putZigzag(data + n, point->lon_udeg - _last.lon_udeg);
+    n += putZigzag(data + n, (int32_t)point->speed_cmps - _last.speed_cmps);
+  }
+  return n;
+}
+
+/********* SIMPLIFIER ***************************************************/
+
+// Meters per microdegree of latitude
+#define FONA_TRACK_M_PER_UDEG 0.11132
+
+/**
+ * @brief Construct a new FONATrackSimplifier object
+ *
+ * @param tolerance How far in meters a dropped point may be from the
+ * simplified track
+ */
+FONATrackSimplifier::FONATrackSimplifier(uint16_t tolerance) {
+  setTolerance(tolerance);
+  reset();
+}
+
+/**
+ * @brief Change the tolerance
+ *
+ * @param tolerance How far in meters a dropped point may be from the
+ * simplified track
+ */
+void FONATrackSimplifier::setTolerance(uint16_t tolerance) {
+  _tolerance = tolerance;
+}
+
+/**
+ * @brief Start a new track, forgetting the points held back
+ *
+ */
+void FONATrackSimplifier::reset(void) {
+  _anchored = false;
+  _count = 0;
+}
+
+/**
+ * @brief Add a point of the raw track
+ *
+ * @param point The point
+ * @param kept Set to a point of the simplified track when one is decided
+ * @return true: kept was set, false: nothing to keep yet
+ */
+bool FONATrackSimplifier::add(const FONATrackPoint* point,
+                              FONATrackPoint* kept) {
+  if (!_anchored) {
+    // the track starts with its first point
+    setAnchor(point);
+    *kept = *point;
+    return true;
+  }
+
+  bool fits = true;
+  for (uint8_t i = 0; fits && (i < _count); i++)
+    fits = (distance(&_window[i], point) <= _tolerance);
+
+  if (fits) {
+    // a point within the tolerance of the anchor is within it of every
+    // segment from the anchor, so while idling only the latest is held
+    if (_count && (distance(&_window[_count - 1], &_anchor) <= _tolerance))
+      _count--;
+    if (_count < FONA_TRACK_WINDOW) {
+      _window[_count++] = *point;
+      return false;
+    }
+  }
+
+  // the point before this one ends the straight run
+  *kept = _window[_count - 1];
+  setAnchor(kept);
+  _window[0] = *point;
+  _count = 1;
+  return true;
+}
+
+/**
+ * @brief End the track, e.g. before an upload, keeping its last point
+ *
+ * @param kept Set to the last point held back
+ * @return true: kept was set, false: no point was held back
+ */
+bool FONATrackSimplifier::flush(FONATrackPoint* kept) {
+  if (!_count)
+    return false;
+
+  *kept = _window[_count - 1];
+  setAnchor(kept);
+  _count = 0;
+  return true;
+}
+
+/**
+ * @brief Start the next straight run at a point
+ *
+ * @param point The last kept point
+ */
+void FONATrackSimplifier::setAnchor(const FONATrackPoint* point) {
+  _anchor = *point;
+  _anchored = true;
+  // longitude degrees shrink towards the poles
+  _xscale = FONA_TRACK_M_PER_UDEG * cos(point->lat_udeg * (M_PI / 180e6));
+}
+
+/**
+ * @brief Get the distance of a point from the segment between the anchor
+ * and a later point, on a flat projection around the anchor
+ *
+ * @param point The point to measure
+ * @param end The end of the segment
+ * @return float The distance in meters
+ */
+float FONATrackSimplifier::distance(const FONATrackPoint* point,
+                                    const FONATrackPoint* end) {
+  float px = (point->lon_udeg - _anchor.lon_udeg) * _xscale;
+  float py = (point->lat_udeg - _anchor.lat_udeg) * FONA_TRACK_M_PER_UDEG;
+  float ex = (end->lon_udeg - _anchor.lon_udeg) * _xscale;
+  float ey = (end->lat_udeg - _anchor.lat_udeg) * FONA_TRACK_M_PER_UDEG;
+
+  // nearest point of the segment, as a fraction of its length
+  float len2 = ex * ex + ey * ey;
+  float t = (len2 > 0) ? (px * ex + py * ey) / len2 : 0;
+  if (t < 0)
+    t = 0;
+  else if (t > 1)
+    t = 1;
+
+  float dx = px - t * ex;
+  float dy = py - t * ey;
+  return sqrt(dx * dx + dy * dy);
+}
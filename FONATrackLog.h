@@ -0,0 +1,108 @@
+/*!
+ * @file FONATrackLog.h
+ *
+ * GPS breadcrumb log: fixes are stored as zigzag varint deltas in fixed size
+ * blocks on a FONAStorage ring, each block starting with a full keyframe, and
+ * exported in the same compact form for upload. A streaming simplifier can
+ * drop the points that add no spatial information before they are logged.
+ *
+ * BSD license, all text above must be included in any redistribution
+ */
+#ifndef FONA_TRACK_LOG_H
+#define FONA_TRACK_LOG_H
+
+#include "FONAStorage.h"
+
+// Bytes per block, including the 2 byte block header (at most 255)
+#ifndef FONA_TRACK_BLOCK
+#define FONA_TRACK_BLOCK 64
+#endif
+
+// Points FONATrackSimplifier holds back while the track runs straight
+#ifndef FONA_TRACK_WINDOW
+#define FONA_TRACK_WINDOW 8
+#endif
+
+/** One track point */
+typedef struct {
+  uint32_t time;       ///< Seconds, e.g. since the epoch
+  int32_t lat_udeg;    ///< Latitude in microdegrees
+  int32_t lon_udeg;    ///< Longitude in microdegrees
+  uint16_t speed_cmps; ///< Speed in cm/s
+} FONATrackPoint;
+
+/** Ring of delta encoded track points. A point takes about 6 bytes while
+ * the track is smooth, against 14 raw. When the ring is full the oldest
+ * block is dropped. The export is the used part of each block, oldest
+ * first: a point count byte, a length byte and that many bytes of points.
+ * The first point of a block is absolute, the others are deltas from the
+ * point before, each as zigzag varints of time, latitude, longitude and
+ * speed. */
+class FONATrackLog {
+ public:
+  FONATrackLog(FONAStorage& storage);
+
+  bool begin(void);
+  bool append(const FONATrackPoint* point);
+  void clear(void);
+
+  uint16_t count(void);
+  void rewind(void);
+  bool next(FONATrackPoint* point);
+
+  uint32_t exportTo(Print& out);
+  static void writeBody(Print& out, void* context);
+
+ private:
+  bool load(void);
+  void save(void);
+  uint32_t blockAddr(uint16_t block);
+  void readBlockHeader(uint16_t block, uint8_t* count, uint8_t* len);
+  uint8_t readPoint(uint32_t addr, uint8_t avail, bool key,
+                    FONATrackPoint* point);
+  uint8_t encode(uint8_t* data, const FONATrackPoint* point, bool key);
+
+  FONAStorage* _storage;
+  uint16_t _nblocks;
+  uint16_t _head;
+  uint16_t _blocks;
+  uint16_t _points;
+  uint8_t _curcount;
+  uint8_t _curlen;
+  FONATrackPoint _last;
+  uint16_t _rdblock;
+  uint8_t _rdleft;
+  uint8_t _rdpos;
+  uint8_t _rdlen;
+  FONATrackPoint _rdlast;
+};
+
+/** Online line simplifier that drops points adding no spatial
+ * information, e.g. while idling or driving straight, before they reach a
+ * FONATrackLog. Opening window: a point is kept only once a later point is
+ * needed to stay within the tolerance of every point in between, so stops
+ * and corners are kept and straight runs collapse to their ends. Memory is
+ * bounded by FONA_TRACK_WINDOW, which also forces a point out on long
+ * straights. */
+class FONATrackSimplifier {
+ public:
+  FONATrackSimplifier(uint16_t tolerance);
+
+  void setTolerance(uint16_t tolerance);
+  void reset(void);
+  bool add(const FONATrackPoint* point, FONATrackPoint* kept);
+  bool flush(FONATrackPoint* kept);
+
+ private:
+  void setAnchor(const FONATrackPoint* point);
+  float distance(const FONATrackPoint* point, const FONATrackPoint* end);
+
+  float _tolerance;
+  float _xscale;
+  bool _anchored;
+  FONATrackPoint _anchor;
+  FONATrackPoint _window[FONA_TRACK_WINDOW];
+  uint8_t _count;
+};
+
+#endif
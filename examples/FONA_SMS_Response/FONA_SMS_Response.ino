@@ -82,69 +82,52 @@ void setup() {
     Serial.print("SIM card IMEI: "); Serial.println(imei);
   }
 
-  fonaSerial->print("AT+CNMI=2,1\r\n");  //set up the FONA to send a +CMTI notification when an SMS is received
+  fona.setSMSNotify(true);  //set up the FONA to send a +CMTI notification when an SMS is received
 
   Serial.println("FONA Ready");
 }
 
   
-char fonaNotificationBuffer[64];          //for notifications from the FONA
 char smsBuffer[250];
 
 void loop() {
   
-  char* bufPtr = fonaNotificationBuffer;    //handy buffer pointer
-  
-  if (fona.available())      //any data available from the FONA?
-  {
-    int slot = 0;            //this will be the slot number of the SMS
-    int charCount = 0;
-    //Read the notification into fonaInBuffer
-    do  {
-      *bufPtr = fona.read();
-      Serial.write(*bufPtr);
-      delay(1);
-    } while ((*bufPtr++ != '\n') && (fona.available()) && (++charCount < (sizeof(fonaNotificationBuffer)-1)));
+  //The driver queues the slot number of each +CMTI notification, so
+  //  checking for new messages costs no AT commands
+  int16_t slot = fona.getNewSMS();
+  if (slot >= 0) {
+    Serial.print("slot: "); Serial.println(slot);
     
-    //Add a terminal NULL to the notification string
-    *bufPtr = 0;
-
-    //Scan the notification string for an SMS received notification.
-    //  If it's an SMS message, we'll get the slot number in 'slot'
-    if (1 == sscanf(fonaNotificationBuffer, "+CMTI: " FONA_PREF_SMS_STORAGE ",%d", &slot)) {
-      Serial.print("slot: "); Serial.println(slot);
-      
-      char callerIDbuffer[32];  //we'll store the SMS sender number in here
-      
-      // Retrieve SMS sender address/phone number.
-      if (! fona.getSMSSender(slot, callerIDbuffer, 31)) {
-        Serial.println("Didn't find SMS message in slot!");
-      }
-      Serial.print(F("FROM: ")); Serial.println(callerIDbuffer);
-
-        // Retrieve SMS value.
-        uint16_t smslen;
-        if (fona.readSMS(slot, smsBuffer, 250, &smslen)) { // pass in buffer and max len!
-          Serial.println(smsBuffer);
-        }
-
-      //Send back an automatic response
-      Serial.println("Sending reponse...");
-      if (!fona.sendSMS(callerIDbuffer, (char *)"Hey, I got your text!")) {
-        Serial.println(F("Failed"));
-      } else {
-        Serial.println(F("Sent!"));
-      }
-      
-      // delete the original msg after it is processed
-      //   otherwise, we will fill up all the slots
-      //   and then we won't be able to receive SMS anymore
-      if (fona.deleteSMS(slot)) {
-        Serial.println(F("OK!"));
-      } else {
-        Serial.print(F("Couldn't delete SMS in slot ")); Serial.println(slot);
-        fona.print(F("AT+CMGD=?\r\n"));
+    char callerIDbuffer[32];  //we'll store the SMS sender number in here
+    
+    // Retrieve SMS sender address/phone number.
+    if (! fona.getSMSSender(slot, callerIDbuffer, 31)) {
+      Serial.println("Didn't find SMS message in slot!");
+    }
+    Serial.print(F("FROM: ")); Serial.println(callerIDbuffer);
+
+      // Retrieve SMS value.
+      uint16_t smslen;
+      if (fona.readSMS(slot, smsBuffer, 250, &smslen)) { // pass in buffer and max len!
+        Serial.println(smsBuffer);
       }
+
+    //Send back an automatic response
+    Serial.println("Sending reponse...");
+    if (!fona.sendSMS(callerIDbuffer, (char *)"Hey, I got your text!")) {
+      Serial.println(F("Failed"));
+    } else {
+      Serial.println(F("Sent!"));
+    }
+    
+    // delete the original msg after it is processed
+    //   otherwise, we will fill up all the slots
+    //   and then we won't be able to receive SMS anymore
+    if (fona.deleteSMS(slot)) {
+      Serial.println(F("OK!"));
+    } else {
+      Serial.print(F("Couldn't delete SMS in slot ")); Serial.println(slot);
+      fona.print(F("AT+CMGD=?\r\n"));
     }
   }
 }
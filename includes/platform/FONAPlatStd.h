@@ -67,6 +67,7 @@ typedef const __FlashStringHelper* FONAFlashStringPtr;
 #define prog_char_strstr(a, b) strstr_P((a), (b))
 #define prog_char_strlen(a) strlen_P((a))
 #define prog_char_strcpy(to, fromprogmem) strcpy_P((to), (fromprogmem))
+#define prog_char_strncasecmp(a, b, n) strncasecmp_P((a), (b), (n))
 // define prog_char_strncpy(to, from, len)		strncpy_P((to),
 // (fromprogmem), (len))
 
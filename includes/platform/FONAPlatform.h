@@ -54,4 +54,8 @@
 #define prog_char_strcpy(to, fromprogmem) strcpy((to), (fromprogmem))
 #endif
 
+#ifndef prog_char_strncasecmp
+#define prog_char_strncasecmp(a, b, n) strncasecmp((a), (b), (n))
+#endif
+
 #endif /* ADAFRUIT_FONA_LIBRARY_SRC_INCLUDES_PLATFORM_FONAPLATFORM_H_ */